@@ -0,0 +1,110 @@
+#include "barriers.hpp"
+
+#include <optional>
+
+namespace {
+    constexpr vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eColorAttachmentWrite |
+                                              vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite |
+                                              vk::AccessFlagBits2::eMemoryWrite;
+
+    struct Dependency {
+        vk::PipelineStageFlags2 srcStage;
+        vk::AccessFlags2        srcAccess;
+        vk::PipelineStageFlags2 dstStage;
+        vk::AccessFlags2        dstAccess;
+    };
+
+    // moves `state` past an access and returns the dependency the access needs, nullopt when whatever came before is already ordered
+    // before it. a layout transition counts as a write at `stage`
+    std::optional<Dependency> advance(ResourceState& state, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, bool transition) {
+        if (transition || (access & WRITE_ACCESS)) {
+            // the reads since the last write were ordered after it (and it was made available to them), so waiting for them is enough
+            Dependency dep{state.readStages, {}, stage, access};
+            if (!state.readStages) {
+                dep.srcStage  = state.writeStages;
+                dep.srcAccess = state.writeAccess;
+            }
+
+            state.writeStages = stage;
+            state.writeAccess = access & WRITE_ACCESS;
+            // a read that comes with a transition happens after it, the barrier orders both
+            bool read         = !(access & WRITE_ACCESS);
+            state.readStages  = read ? stage : vk::PipelineStageFlags2{};
+            state.readAccess  = read ? access : vk::AccessFlags2{};
+
+            if (!dep.srcStage && !transition) return std::nullopt;
+            return dep;
+        }
+
+        if (!state.writeStages) {
+            // nothing written yet, only a later write has to wait for this
+            state.readStages |= stage;
+            state.readAccess |= access;
+            return std::nullopt;
+        }
+        if ((state.readStages & stage) == stage && (state.readAccess & access) == access) return std::nullopt;
+
+        // the barrier covers every read so far, which keeps the test above exact for all of them
+        state.readStages |= stage;
+        state.readAccess |= access;
+        return Dependency{state.writeStages, state.writeAccess, state.readStages, state.readAccess};
+    }
+} // namespace
+
+bool isWriteAccess(vk::AccessFlags2 access) {
+    return (bool)(access & WRITE_ACCESS);
+}
+
+void BarrierBatch::use(Image &image, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageLayout layout) {
+    bool discard    = layout == vk::ImageLayout::eUndefined;
+    bool transition = !discard && layout != image.state.layout;
+
+    auto dep = advance(image.state, stage, access, transition);
+    if (!dep) return;
+
+    if (discard) {
+        m_Memory.push_back(vk::MemoryBarrier2(dep->srcStage, dep->srcAccess, dep->dstStage, dep->dstAccess));
+        return;
+    }
+
+    m_Images.push_back(vk::ImageMemoryBarrier2(dep->srcStage, dep->srcAccess, dep->dstStage, dep->dstAccess, image.state.layout, layout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image.image, STANDARD_ISR));
+    image.state.layout = layout;
+}
+
+void BarrierBatch::use(Buffer &buffer, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access) {
+    auto dep = advance(buffer.state, stage, access, false);
+    if (!dep) return;
+
+    m_Buffers.push_back(vk::BufferMemoryBarrier2(dep->srcStage, dep->srcAccess, dep->dstStage, dep->dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buffer.buffer, 0, VK_WHOLE_SIZE));
+}
+
+void BarrierBatch::release(Image &image, uint32_t srcFamily, uint32_t dstFamily) {
+    const ResourceState& state = image.state;
+    m_Images.push_back(vk::ImageMemoryBarrier2(state.writeStages | state.readStages, state.writeAccess, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, state.layout, state.layout,
+                                               srcFamily, dstFamily, image.image, STANDARD_ISR));
+
+    // nothing on this queue touches it anymore, the acquiring side starts over
+    image.state = {state.layout};
+}
+
+void BarrierBatch::acquire(Image &image, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access) {
+    vk::ImageLayout layout = image.state.layout;
+    m_Images.push_back(vk::ImageMemoryBarrier2(vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, stage, access, layout, layout, srcFamily, dstFamily, image.image, STANDARD_ISR));
+
+    image.state = {layout};
+    advance(image.state, stage, access, true);
+}
+
+void BarrierBatch::flush(const vk::CommandBuffer &cmd) {
+    if (empty()) return;
+
+    vk::DependencyInfo dependency{};
+    dependency.setMemoryBarriers(m_Memory);
+    dependency.setImageMemoryBarriers(m_Images);
+    dependency.setBufferMemoryBarriers(m_Buffers);
+    cmd.pipelineBarrier2(dependency);
+
+    m_Memory.clear();
+    m_Images.clear();
+    m_Buffers.clear();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "setup.hpp"
+
+#include <vector>
+
+// builds synchronization2 barriers from the ResourceState tracked on images and buffers and records them in one vkCmdPipelineBarrier2.
+// declare every use the next commands make, flush, then record the commands. a read of data an earlier barrier already made visible
+// to the same stage and access needs nothing, a write only waits for the reads since the last write (or for that write when there
+// were none). barriers cover whole resources, one use per resource per batch
+class BarrierBatch {
+  public:
+    // `layout` is the layout the commands need. eUndefined keeps the current one and discards the contents, e.g. for a render pass
+    // that starts from eUndefined and transitions on its own: it only has to wait for the earlier accesses
+    void use(Image& image, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageLayout layout = vk::ImageLayout::eUndefined);
+    void use(Buffer& buffer, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access);
+
+    // queue family ownership transfer: the release goes on the old family's queue, the acquire (same families) on the new one after
+    // a semaphore wait. the layout stays as it is, transition before the release or after the acquire
+    void release(Image& image, uint32_t srcFamily, uint32_t dstFamily);
+    void acquire(Image& image, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access);
+
+    void flush(const vk::CommandBuffer& cmd);
+
+    [[nodiscard]] inline bool empty() const noexcept { return m_Memory.empty() && m_Images.empty() && m_Buffers.empty(); };
+
+  private:
+    std::vector<vk::MemoryBarrier2>       m_Memory; // discards, there's no layout to name
+    std::vector<vk::ImageMemoryBarrier2>  m_Images;
+    std::vector<vk::BufferMemoryBarrier2> m_Buffers;
+};
+
+// whether `access` contains a write, e.g. to tell a pass' outputs from its inputs
+[[nodiscard]] bool isWriteAccess(vk::AccessFlags2 access);
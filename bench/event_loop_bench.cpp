@@ -0,0 +1,96 @@
+#include "setup.hpp"
+#include "gpu_task.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// one thread driving every gpu in the system through a chain of dependent submissions (each step is only submitted once the
+// previous one finished, like a render whose readback decides what comes next). blocking on each ticket in turn leaves every
+// other gpu idle while one is waited on, co_awaiting them on a GpuEventLoop keeps all of them busy from the same thread.
+// with a single gpu both take about the same time.
+
+constexpr vk::DeviceSize FILL_BYTES = 256ull << 20;
+constexpr uint32_t       FILLS      = 8; // per step, so a step is a few milliseconds of gpu work
+constexpr int            STEPS      = 50;
+
+struct Device {
+    std::unique_ptr<GraphicsContext> gc;
+    Buffer                           target;
+};
+
+CommandTicket submitStep(Device& device, uint32_t step) {
+    return device.gc->recordAndSubmit([&](const vk::CommandBuffer& cmd) {
+        for (uint32_t i = 0; i < FILLS; i++) {
+            cmd.fillBuffer(device.target.buffer, 0, VK_WHOLE_SIZE, step * FILLS + i);
+        }
+    });
+}
+
+GpuTask runSteps(GpuEventLoop& loop, Device& device) {
+    for (int step = 0; step < STEPS; step++) {
+        co_await loop.after(*device.gc, submitStep(device, (uint32_t)step));
+    }
+}
+
+template<typename F>
+double timeMs(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    auto instance = createInstance();
+
+    std::vector<Device> devices;
+    size_t              i = 0;
+    for (auto gpu : instance.enumeratePhysicalDevices()) {
+        printGpuInfo(i, gpu);
+
+        Device device;
+        device.gc     = std::make_unique<GraphicsContext>(instance, gpu);
+        device.target = device.gc->createBufferDevice(FILL_BYTES, vk::BufferUsageFlagBits::eTransferDst);
+        devices.push_back(std::move(device));
+    }
+
+    // warmup, and the drivers get to allocate whatever they allocate lazily
+    for (auto& device : devices) {
+        device.gc->waitForCommands(submitStep(device, 0));
+    }
+
+    double blocking = timeMs([&]() {
+        for (int step = 0; step < STEPS; step++) {
+            for (auto& device : devices) {
+                device.gc->waitForCommands(submitStep(device, (uint32_t)step));
+            }
+        }
+    });
+
+    double awaited = timeMs([&]() {
+        GpuEventLoop         loop;
+        std::vector<GpuTask> tasks;
+        for (auto& device : devices) {
+            tasks.push_back(runSteps(loop, device));
+        }
+        loop.run();
+
+        for (const auto& task : tasks) {
+            task.get();
+        }
+    });
+
+    std::cout << devices.size() << " gpus, " << STEPS << " dependent steps each\n";
+    std::cout << "blocking waits: " << blocking << " ms\n";
+    std::cout << "event loop:     " << awaited << " ms (" << blocking / awaited << "x)" << std::endl;
+
+    for (auto& device : devices) {
+        device.gc->getDevice().waitIdle();
+        device.gc->destroy(device.target);
+        device.gc.reset();
+    }
+
+    instance.destroy();
+    return 0;
+}
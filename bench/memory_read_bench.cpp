@@ -0,0 +1,73 @@
+#include "setup.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// cpu read bandwidth out of every host-visible memory type, to show why readback buffers want HOST_CACHED memory.
+// also prints which types createBufferHost and createReadbackBuffer end up in.
+
+constexpr vk::DeviceSize BENCH_BYTES      = 64ull << 20;
+constexpr int            BENCH_ITERATIONS = 5;
+
+void benchGpu(vk::Instance instance, vk::PhysicalDevice gpu) {
+    auto* gc  = new GraphicsContext(instance, gpu);
+    auto  dev = gc->getDevice();
+
+    vk::PhysicalDeviceMemoryProperties memProps = gpu.getMemoryProperties();
+    std::vector<uint8_t>               dst(BENCH_BYTES);
+
+    for (uint32_t type = 0; type < memProps.memoryTypeCount; type++) {
+        vk::MemoryPropertyFlags flags = memProps.memoryTypes[type].propertyFlags;
+        if (!(flags & vk::MemoryPropertyFlagBits::eHostVisible)) continue;
+
+        vk::Buffer             buffer = dev.createBuffer(vk::BufferCreateInfo({}, BENCH_BYTES, vk::BufferUsageFlagBits::eTransferDst, vk::SharingMode::eExclusive));
+        vk::MemoryRequirements reqs   = dev.getBufferMemoryRequirements(buffer);
+        if (!(reqs.memoryTypeBits & (1u << type)) || memProps.memoryHeaps[memProps.memoryTypes[type].heapIndex].size < reqs.size * 2) {
+            gc->destroy(buffer);
+            continue;
+        }
+
+        vk::DeviceMemory memory = dev.allocateMemory(vk::MemoryAllocateInfo(reqs.size, type));
+        dev.bindBufferMemory(buffer, memory, 0);
+
+        void* map = gc->mapMemory(memory, 0, VK_WHOLE_SIZE, {});
+        memset(map, 0x5a, BENCH_BYTES); // touch every page once so the first timed read doesn't pay for faults
+
+        double best = 1e30;
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!(flags & vk::MemoryPropertyFlagBits::eHostCoherent)) dev.invalidateMappedMemoryRanges(vk::MappedMemoryRange(memory, 0, VK_WHOLE_SIZE));
+            memcpy(dst.data(), map, BENCH_BYTES);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        std::cout << "type " << type << " (heap " << memProps.memoryTypes[type].heapIndex << ", " << vk::to_string(flags) << "): " << (double)BENCH_BYTES / best / 1e9 << " GB/s\n";
+
+        gc->unmapMemory(memory);
+        gc->destroy(buffer);
+        dev.freeMemory(memory);
+    }
+
+    Buffer       host     = gc->createBufferHost(BENCH_BYTES, vk::BufferUsageFlagBits::eTransferDst);
+    MappedBuffer readback = gc->createReadbackBuffer(BENCH_BYTES);
+    std::cout << "createBufferHost -> type " << host.allocationInfo.memoryType << ", createReadbackBuffer -> type " << readback.allocationInfo.memoryType << std::endl;
+    gc->destroy(host);
+    gc->destroy(readback);
+
+    delete gc;
+}
+
+int main() {
+    auto instance = createInstance();
+
+    size_t i = 0;
+    for (auto gpu : instance.enumeratePhysicalDevices()) {
+        printGpuInfo(i, gpu);
+        benchGpu(instance, gpu);
+    }
+
+    instance.destroy();
+    return 0;
+}
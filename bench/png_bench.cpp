@@ -0,0 +1,150 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+#include "image_writer.hpp"
+#include "png_writer.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// compares stbi_write_png with the parallel writePng on a synthetic rgba frame (gradients plus a bit of noise,
+// so neither encoder gets an unrealistically easy time), then the other ImageWriter formats for reference.
+// before timing anything the qoi writer's output is decoded again and compared with its input.
+
+std::vector<uint8_t> makeFrame(uint32_t size) {
+    std::vector<uint8_t> frame((size_t)size * size * 4);
+    uint32_t             rng = 0x12345678;
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            rng            = rng * 1664525u + 1013904223u;
+            uint8_t* p     = &frame[((size_t)y * size + x) * 4];
+            p[0]           = (uint8_t)(x * 255 / size);
+            p[1]           = (uint8_t)(y * 255 / size);
+            p[2]           = (uint8_t)((x ^ y) + (rng >> 29));
+            p[3]           = 255;
+        }
+    }
+    return frame;
+}
+
+// plain qoi decoder for the check below, rgba out. empty on a malformed stream
+std::vector<uint8_t> decodeQoi(const std::vector<uint8_t>& data, uint32_t& width, uint32_t& height) {
+    if (data.size() < 14 + 8 || data[0] != 'q' || data[1] != 'o' || data[2] != 'i' || data[3] != 'f') return {};
+    width  = (uint32_t)data[4] << 24 | (uint32_t)data[5] << 16 | (uint32_t)data[6] << 8 | data[7];
+    height = (uint32_t)data[8] << 24 | (uint32_t)data[9] << 16 | (uint32_t)data[10] << 8 | data[11];
+
+    std::vector<uint8_t>                   pixels((size_t)width * height * 4);
+    std::array<std::array<uint8_t, 4>, 64> index{};
+    std::array<uint8_t, 4>                 px  = {0, 0, 0, 255};
+    size_t                                 pos = 14, end = data.size() - 8;
+    uint32_t                               run = 0;
+
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        if (run > 0) {
+            run--;
+        } else {
+            if (pos >= end) return {};
+            uint8_t op = data[pos++];
+
+            if (op == 0xfe || op == 0xff) {
+                size_t n = op == 0xff ? 4 : 3;
+                if (pos + n > end) return {};
+                for (size_t c = 0; c < n; c++) px[c] = data[pos++];
+            } else if ((op & 0xc0) == 0x00) {
+                px = index[op];
+            } else if ((op & 0xc0) == 0x40) {
+                px[0] += ((op >> 4) & 3) - 2;
+                px[1] += ((op >> 2) & 3) - 2;
+                px[2] += (op & 3) - 2;
+            } else if ((op & 0xc0) == 0x80) {
+                if (pos >= end) return {};
+                int     dg = (op & 0x3f) - 32;
+                uint8_t b  = data[pos++];
+                px[0] += dg - 8 + (b >> 4);
+                px[1] += dg;
+                px[2] += dg - 8 + (b & 0x0f);
+            } else {
+                run = op & 0x3f;
+            }
+            index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64] = px;
+        }
+        std::copy(px.begin(), px.end(), pixels.begin() + (ptrdiff_t)i);
+    }
+    return pixels;
+}
+
+// the worst case row: a run still pending from the row above (flushed as one byte in front of the row) followed by a
+// QOI_OP_RGBA for every pixel, 5 * width + 1 bytes
+bool checkQoi() {
+    constexpr uint32_t   width = 16, height = 4;
+    std::vector<uint8_t> image((size_t)width * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t* p = &image[((size_t)y * width + x) * 4];
+            if (y % 2 == 0) {
+                // one color over the whole row, it ends in a run
+                p[0] = 10, p[1] = 20, p[2] = 30, p[3] = (uint8_t)(40 + y);
+            } else {
+                // alpha changes every pixel and no color repeats, so no index hits either
+                p[0] = (uint8_t)(x * 13 + y), p[1] = (uint8_t)(x * 29 + 7), p[2] = (uint8_t)(x * 41 + 3), p[3] = (uint8_t)(100 + x + y * width);
+            }
+        }
+    }
+
+    std::string path = "bench_check.qoi";
+    writeImage(OutputFormat::eQoi, path, image.data(), width, height, 4);
+
+    std::ifstream        in(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::filesystem::remove(path);
+
+    uint32_t decodedW = 0, decodedH = 0;
+    auto     decoded  = decodeQoi(data, decodedW, decodedH);
+    return decodedW == width && decodedH == height && decoded == image;
+}
+
+template<typename F>
+double timeMs(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    if (!checkQoi()) {
+        std::cerr << "qoi round trip failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "threads: " << ThreadPool::shared().size() << '\n';
+
+    for (uint32_t size : {1024u, 4096u, 8192u}) {
+        auto frame = makeFrame(size);
+
+        double stb = timeMs([&]() { stbi_write_png("bench_stb.png", (int)size, (int)size, 4, frame.data(), 0); });
+        double par = timeMs([&]() { writePng("bench_parallel.png", frame.data(), size, size, 4); });
+
+        std::cout << size << 'x' << size << ": stb " << stb << " ms (" << std::filesystem::file_size("bench_stb.png") << " bytes), parallel " << par << " ms ("
+                  << std::filesystem::file_size("bench_parallel.png") << " bytes), " << stb / par << "x" << std::endl;
+
+        for (OutputFormat format : {OutputFormat::eQoi, OutputFormat::ePam, OutputFormat::eRaw}) {
+            std::string path = std::string("bench_out.") + formatExtension(format);
+
+            double ms = timeMs([&]() { writeImage(format, path, frame.data(), size, size, 4); });
+            std::cout << "    " << formatExtension(format) << ' ' << ms << " ms (" << std::filesystem::file_size(path) << " bytes), " << stb / ms << "x vs stb" << std::endl;
+            std::filesystem::remove(path);
+        }
+    }
+
+    std::filesystem::remove("bench_stb.png");
+    std::filesystem::remove("bench_parallel.png");
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "setup.hpp"
+#include "barriers.hpp"
+
+#include <iostream>
+#include <chrono>
+
+// compares the old two-hop readback (optimal image -> linear host image -> host buffer) with GraphicsContext::readbackImage
+// (optimal image -> host buffer) on every gpu in the system.
+
+constexpr uint32_t BENCH_SIZE       = 8192;
+constexpr int      BENCH_ITERATIONS = 10;
+
+double runBench(GraphicsContext* gc, const std::function<void(const vk::CommandBuffer&)>& f) {
+    gc->runCommands(f); // warmup
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        gc->runCommands(f);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / BENCH_ITERATIONS;
+}
+
+void benchGpu(vk::Instance instance, vk::PhysicalDevice gpu) {
+    auto* gc = new GraphicsContext(instance, gpu);
+
+    Image  deviceImage = gc->createImageDevice(BENCH_SIZE, BENCH_SIZE, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst, vk::ImageTiling::eOptimal);
+    Image  hostImage   = gc->createImageHost(BENCH_SIZE, BENCH_SIZE, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc, vk::ImageTiling::eLinear, true);
+    Buffer hostBuffer  = gc->createBufferHost(BENCH_SIZE * BENCH_SIZE * 4, vk::BufferUsageFlagBits::eTransferDst);
+
+    gc->runCommands([&](const vk::CommandBuffer& cmd) {
+        BarrierBatch barriers;
+        barriers.use(deviceImage, vk::PipelineStageFlagBits2::eClear, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal);
+        barriers.flush(cmd);
+        cmd.clearColorImage(deviceImage.image, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue(1.0f, 0.0f, 1.0f, 1.0f), STANDARD_ISR);
+
+        barriers.use(deviceImage, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal);
+        barriers.flush(cmd);
+    });
+
+    double twoHop = runBench(gc, [&](const vk::CommandBuffer& cmd) {
+        vk::ImageMemoryBarrier imb({}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, hostImage.image, STANDARD_ISR);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imb);
+
+        vk::ImageCopy region(STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, deviceImage.extent);
+        cmd.copyImage(deviceImage.image, vk::ImageLayout::eTransferSrcOptimal, hostImage.image, vk::ImageLayout::eTransferDstOptimal, region);
+
+        imb = vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, hostImage.image, STANDARD_ISR);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imb);
+
+        vk::BufferImageCopy region2(0, 0, 0, STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, hostImage.extent);
+        cmd.copyImageToBuffer(hostImage.image, vk::ImageLayout::eTransferSrcOptimal, hostBuffer.buffer, region2);
+    });
+
+    double direct = runBench(gc, [&](const vk::CommandBuffer& cmd) { gc->recordReadback(cmd, deviceImage, hostBuffer); });
+
+    double frameBytes = (double)BENCH_SIZE * BENCH_SIZE * 4;
+    // the two-hop path writes the frame twice and reads it twice, the direct path once each
+    std::cout << "two-hop: " << twoHop << " ms/frame, " << (2.0 * frameBytes / (1024.0 * 1024.0)) << " MB copied, " << (frameBytes / (twoHop / 1000.0)) / 1e9 << " GB/s effective\n";
+    std::cout << "direct:  " << direct << " ms/frame, " << (frameBytes / (1024.0 * 1024.0)) << " MB copied, " << (frameBytes / (direct / 1000.0)) / 1e9 << " GB/s effective\n";
+    std::cout << "speedup: " << twoHop / direct << "x" << std::endl;
+
+    gc->destroy(deviceImage);
+    gc->destroy(hostImage);
+    gc->destroy(hostBuffer);
+
+    delete gc;
+}
+
+int main() {
+    auto instance = createInstance();
+
+    size_t i = 0;
+    for (auto gpu : instance.enumeratePhysicalDevices()) {
+        printGpuInfo(i, gpu);
+        benchGpu(instance, gpu);
+    }
+
+    instance.destroy();
+    return 0;
+}
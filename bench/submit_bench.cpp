@@ -0,0 +1,73 @@
+#include "setup.hpp"
+
+#include <iostream>
+#include <chrono>
+
+// cpu cost of getting a callback recorded: through a std::function (runCommandsAsync, the lambda gets wrapped and, with a capture
+// bigger than the small buffer, heap allocated on every call) against the templated record/recordAndSubmit, which call it directly.
+// "record" only begins/ends a command buffer around the callback, "submit" goes through the ring and vkQueueSubmit as well.
+
+constexpr int RECORD_ITERATIONS = 200000;
+constexpr int SUBMIT_ITERATIONS = 20000;
+
+template<typename F>
+double timePerCall(int iterations, F&& f) {
+    f(); // warmup
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        f();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+void benchGpu(vk::Instance instance, vk::PhysicalDevice gpu) {
+    auto* gc = new GraphicsContext(instance, gpu);
+
+    Buffer target = gc->createBufferDevice(4096, vk::BufferUsageFlagBits::eTransferDst);
+
+    // captures like the renderer's callbacks: a handful of references, well past std::function's small buffer
+    vk::DeviceSize offset = 0, size = 4;
+    uint32_t       value = 0x11223344, repeats = 4;
+    const Buffer&  buffer = target;
+    vk::DeviceSize stride = 64;
+    auto           commands = [&](const vk::CommandBuffer& cmd) {
+        for (uint32_t i = 0; i < repeats; i++) {
+            cmd.fillBuffer(buffer.buffer, offset + i * stride, size, value);
+        }
+    };
+
+    vk::CommandBuffer cmd = gc->getDevice().allocateCommandBuffers(vk::CommandBufferAllocateInfo(gc->threadCommandPool(), vk::CommandBufferLevel::ePrimary, 1))[0];
+
+    double recordErased = timePerCall(RECORD_ITERATIONS, [&]() { gc->record(cmd, std::function<void(const vk::CommandBuffer&)>(commands)); });
+    double recordInline = timePerCall(RECORD_ITERATIONS, [&]() { gc->record(cmd, commands); });
+
+    double submitErased = timePerCall(SUBMIT_ITERATIONS, [&]() { auto _ = gc->runCommandsAsync(commands); });
+    gc->getDevice().waitIdle();
+    double submitInline = timePerCall(SUBMIT_ITERATIONS, [&]() { auto _ = gc->recordAndSubmit(commands); });
+    gc->getDevice().waitIdle();
+
+    std::cout << "record, std::function: " << recordErased << " us/call\n";
+    std::cout << "record, template:      " << recordInline << " us/call (" << recordErased / recordInline << "x)\n";
+    std::cout << "submit, std::function: " << submitErased << " us/call\n";
+    std::cout << "submit, template:      " << submitInline << " us/call (" << submitErased / submitInline << "x)" << std::endl;
+
+    gc->destroy(target);
+
+    delete gc;
+}
+
+int main() {
+    auto instance = createInstance();
+
+    size_t i = 0;
+    for (auto gpu : instance.enumeratePhysicalDevices()) {
+        printGpuInfo(i, gpu);
+        benchGpu(instance, gpu);
+    }
+
+    instance.destroy();
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "disk_cache.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+    std::mutex            s_DirMutex;
+    std::filesystem::path s_Dir;
+    bool                  s_DirSet = false;
+} // namespace
+
+void setCacheDirectory(const std::filesystem::path &dir) {
+    std::lock_guard lock(s_DirMutex);
+    s_Dir    = dir;
+    s_DirSet = true;
+}
+
+std::filesystem::path cacheDirectory() {
+    std::lock_guard lock(s_DirMutex);
+    if (!s_DirSet) {
+        const char* env = std::getenv("BS_CACHE_DIR");
+        s_Dir           = env && *env ? std::filesystem::path(env) : std::filesystem::path(".bs_cache");
+        s_DirSet        = true;
+    }
+    return s_Dir;
+}
+
+std::optional<std::vector<uint8_t>> readCacheFile(const std::filesystem::path &name) {
+    std::ifstream f(cacheDirectory() / name, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!f) return std::nullopt;
+
+    auto size = f.tellg();
+    if (size <= 0) return std::nullopt;
+
+    std::vector<uint8_t> data((size_t)size);
+    f.seekg(0);
+    if (!f.read((char*)data.data(), size)) return std::nullopt;
+
+    return data;
+}
+
+void writeCacheFile(const std::filesystem::path &name, const void *data, size_t size) {
+    static std::atomic<uint64_t> counter = 0;
+
+    std::filesystem::path target = cacheDirectory() / name;
+    std::error_code       ec;
+    std::filesystem::create_directories(target.parent_path(), ec);
+
+    // unique per thread and per call, the timestamp separates processes
+    std::stringstream tmpName;
+    tmpName << target.filename().string() << ".tmp." << std::hash<std::thread::id>{}(std::this_thread::get_id()) << '.' << counter++ << '.'
+            << std::chrono::steady_clock::now().time_since_epoch().count();
+    std::filesystem::path tmp = target.parent_path() / tmpName.str();
+
+    {
+        std::ofstream f(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        f.write((const char*)data, (std::streamsize)size);
+        if (!f) {
+            std::cerr << "Failed to write cache file " << tmp << std::endl;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp, target, ec);
+    if (ec) {
+        std::cerr << "Failed to move cache file into place " << target << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmp, ec);
+    }
+}
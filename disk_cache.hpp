@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// on-disk cache shared by every GraphicsContext in the process (spir-v, pipeline caches).
+// the directory defaults to $BS_CACHE_DIR, or .bs_cache in the working directory when that isn't set.
+void                  setCacheDirectory(const std::filesystem::path& dir);
+std::filesystem::path cacheDirectory();
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME        = 0x100000001b3ull;
+
+[[nodiscard]] inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) noexcept {
+    const auto* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+[[nodiscard]] inline uint64_t fnv1a(std::string_view s, uint64_t hash = FNV_OFFSET_BASIS) noexcept {
+    // the terminator is hashed too, so ("ab", "c") and ("a", "bc") give different keys
+    return fnv1a("", 1, fnv1a(s.data(), s.size(), hash));
+}
+
+// `name` is relative to the cache directory. a missing or unreadable file is a miss, not an error
+[[nodiscard]] std::optional<std::vector<uint8_t>> readCacheFile(const std::filesystem::path& name);
+
+// writes to a temporary file next to the target and renames it into place, so concurrent writers (threads or
+// processes) never expose a half written file. failures are reported on stderr and otherwise ignored
+void writeCacheFile(const std::filesystem::path& name, const void* data, size_t size);
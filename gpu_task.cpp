@@ -0,0 +1,54 @@
+#include "gpu_task.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+size_t GpuEventLoop::poll() {
+    // resuming may park the coroutine again (or start others), so the ready ones are taken out first
+    std::vector<std::coroutine_handle<>> ready;
+    std::erase_if(m_Waiting, [&](const Waiting& w) {
+        if (!w.gc->commandsComplete(w.ticket)) return false;
+        ready.push_back(w.handle);
+        return true;
+    });
+
+    for (auto handle : ready) {
+        handle.resume();
+    }
+    return ready.size();
+}
+
+void GpuEventLoop::run(std::chrono::nanoseconds slice) {
+    while (!m_Waiting.empty()) {
+        if (poll() > 0) continue;
+
+        // nothing ready: sleep on one context's tickets (a wait can't span devices), taking turns between the contexts
+        std::vector<GraphicsContext*> contexts;
+        for (const auto& w : m_Waiting) {
+            if (std::find(contexts.begin(), contexts.end(), w.gc) == contexts.end()) contexts.push_back(w.gc);
+        }
+        GraphicsContext* gc = contexts[m_NextContext++ % contexts.size()];
+
+        std::vector<vk::Semaphore> semaphores;
+        std::vector<uint64_t>      values;
+        for (const auto& w : m_Waiting) {
+            if (w.gc != gc || !w.ticket.semaphore) continue;
+            semaphores.push_back(w.ticket.semaphore);
+            values.push_back(w.ticket.value);
+        }
+        if (semaphores.empty()) continue;
+
+        vk::SemaphoreWaitInfo wi(vk::SemaphoreWaitFlagBits::eAny, semaphores, values);
+        auto _ = gc->getDevice().waitSemaphores(wi, (uint64_t)slice.count());
+    }
+}
+
+GpuTask::~GpuTask() {
+    if (m_Handle) m_Handle.destroy();
+}
+
+void GpuTask::get() const {
+    if (!m_Handle) throw std::logic_error("GpuTask::get on a moved-from task");
+    if (!m_Handle.done()) throw std::logic_error("GpuTask::get on a coroutine that is still running");
+    if (m_Handle.promise().error) std::rethrow_exception(m_Handle.promise().error);
+}
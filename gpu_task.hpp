@@ -0,0 +1,76 @@
+#pragma once
+#include "setup.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+
+// resumes coroutines once their CommandTickets complete. one thread drives any number of contexts through run()/poll() and never
+// blocks on a single submission: `co_await loop.after(gc, ticket)` parks the coroutine until the ticket's timeline value is reached.
+// not thread safe, coroutines are resumed on the thread calling poll
+class GpuEventLoop {
+  public:
+    struct Awaiter {
+        GpuEventLoop&    loop;
+        GraphicsContext& gc;
+        CommandTicket    ticket;
+
+        [[nodiscard]] bool await_ready() const { return gc.commandsComplete(ticket); };
+        void await_suspend(std::coroutine_handle<> handle) { loop.m_Waiting.push_back({&gc, ticket, handle}); };
+        void await_resume() const noexcept {};
+    };
+
+    [[nodiscard]] Awaiter after(GraphicsContext& gc, const CommandTicket& ticket) { return {*this, gc, ticket}; };
+
+    // resumes every coroutine whose ticket completed (including ones they park again), returns how many
+    size_t poll();
+    // polls until nothing is parked. in between it sleeps in a wait-any on one context's pending tickets for at most `slice`, so the
+    // other contexts are looked at again at least that often
+    void run(std::chrono::nanoseconds slice = std::chrono::milliseconds(1));
+
+    [[nodiscard]] inline bool empty() const noexcept { return m_Waiting.empty(); };
+
+  private:
+    struct Waiting {
+        GraphicsContext*        gc;
+        CommandTicket           ticket;
+        std::coroutine_handle<> handle;
+    };
+
+    std::vector<Waiting> m_Waiting;
+    size_t               m_NextContext = 0; // round robin over the contexts run() sleeps on
+};
+
+// coroutine driven by a GpuEventLoop. it starts right away and runs until it awaits an unfinished ticket. the task owns the frame,
+// done() tells whether it finished and get() rethrows what escaped it. keep the task alive while it's parked on a loop
+class GpuTask {
+  public:
+    struct promise_type {
+        std::exception_ptr error;
+
+        GpuTask get_return_object() { return GpuTask(std::coroutine_handle<promise_type>::from_promise(*this)); };
+        std::suspend_never initial_suspend() noexcept { return {}; };
+        std::suspend_always final_suspend() noexcept { return {}; };
+        void return_void() noexcept {};
+        void unhandled_exception() noexcept { error = std::current_exception(); };
+    };
+
+    GpuTask(GpuTask&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {};
+    ~GpuTask();
+
+    GpuTask(const GpuTask&)            = delete;
+    GpuTask& operator=(const GpuTask&) = delete;
+    GpuTask& operator=(GpuTask&&)      = delete;
+
+    // a moved-from task counts as done
+    [[nodiscard]] inline bool done() const noexcept { return !m_Handle || m_Handle.done(); };
+    // the coroutine must be done
+    void get() const;
+
+  private:
+    explicit GpuTask(std::coroutine_handle<promise_type> handle) : m_Handle(handle) {};
+
+    std::coroutine_handle<promise_type> m_Handle;
+};
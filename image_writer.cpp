@@ -0,0 +1,340 @@
+#include "image_writer.hpp"
+#include "png_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    std::ofstream openOutput(const std::string& path) {
+        std::ofstream f(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!f) throw std::runtime_error("failed to open " + path);
+        return f;
+    }
+
+    // base for the formats that are a header followed by (possibly converted) rows
+    class StreamWriter : public ImageWriter {
+      public:
+        StreamWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels)
+            : m_Path(path), m_File(openOutput(path)), m_Width(width), m_Height(height), m_Channels(channels) {};
+
+        void finish() override {
+            if (m_RowsWritten != m_Height) throw std::runtime_error(m_Path + " is missing rows");
+            finishData();
+
+            m_File.flush();
+            if (!m_File) throw std::runtime_error("failed to write " + m_Path);
+            m_File.close();
+        };
+
+      protected:
+        std::string   m_Path;
+        std::ofstream m_File;
+        uint32_t      m_Width;
+        uint32_t      m_Height;
+        uint32_t      m_Channels;
+        uint32_t      m_RowsWritten = 0;
+
+        uint32_t clampRows(uint32_t count) {
+            count = std::min(count, m_Height - m_RowsWritten);
+            m_RowsWritten += count;
+            return count;
+        };
+
+        // copies rows as they are, in one write when they're tightly packed
+        void writePacked(const uint8_t* rows, uint32_t count, size_t stride) {
+            size_t rowBytes = (size_t)m_Width * m_Channels;
+            if (stride == 0) stride = rowBytes;
+
+            if (stride == rowBytes) {
+                m_File.write((const char*)rows, (std::streamsize)(rowBytes * count));
+                return;
+            }
+
+            for (uint32_t r = 0; r < count; r++) {
+                m_File.write((const char*)(rows + r * stride), (std::streamsize)rowBytes);
+            }
+        };
+
+        virtual void finishData() {};
+    };
+
+    class RawWriter : public StreamWriter {
+      public:
+        using StreamWriter::StreamWriter;
+
+        void writeRows(const void* rows, uint32_t count, size_t stride) override {
+            writePacked((const uint8_t*)rows, clampRows(count), stride);
+        };
+    };
+
+    class PamWriter : public StreamWriter {
+      public:
+        PamWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels) : StreamWriter(path, width, height, channels) {
+            m_File << rawLayoutHeader(OutputFormat::ePam, width, height, channels);
+        };
+
+        void writeRows(const void* rows, uint32_t count, size_t stride) override {
+            writePacked((const uint8_t*)rows, clampRows(count), stride);
+        };
+    };
+
+    class PpmWriter : public StreamWriter {
+      public:
+        PpmWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels) : StreamWriter(path, width, height, channels) {
+            m_File << "P6\n" << width << ' ' << height << "\n255\n";
+            m_Row.resize((size_t)width * 3);
+        };
+
+        void writeRows(const void* rows, uint32_t count, size_t stride) override {
+            count = clampRows(count);
+            if (m_Channels == 3) {
+                writePacked((const uint8_t*)rows, count, stride);
+                return;
+            }
+
+            if (stride == 0) stride = (size_t)m_Width * m_Channels;
+            for (uint32_t r = 0; r < count; r++) {
+                const uint8_t* src = (const uint8_t*)rows + r * stride;
+                for (uint32_t x = 0; x < m_Width; x++) {
+                    const uint8_t* px = src + (size_t)x * m_Channels;
+                    // gray (+alpha) is spread over rgb, rgba loses its alpha
+                    m_Row[x * 3 + 0] = px[0];
+                    m_Row[x * 3 + 1] = m_Channels >= 3 ? px[1] : px[0];
+                    m_Row[x * 3 + 2] = m_Channels >= 3 ? px[2] : px[0];
+                }
+                m_File.write((const char*)m_Row.data(), (std::streamsize)m_Row.size());
+            }
+        };
+
+      private:
+        std::vector<uint8_t> m_Row;
+    };
+
+    // https://qoiformat.org/qoi-specification.pdf
+    class QoiWriter : public StreamWriter {
+      public:
+        QoiWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels) : StreamWriter(path, width, height, channels) {
+            if (channels != 3 && channels != 4) throw std::runtime_error("qoi: only rgb and rgba are supported");
+
+            uint8_t header[14] = {'q', 'o', 'i', 'f', (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+                                  (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)channels, 0};
+            m_File.write((const char*)header, 14);
+            m_Index.fill({0, 0, 0, 0});
+        };
+
+        void writeRows(const void* rows, uint32_t count, size_t stride) override {
+            count = clampRows(count);
+            if (stride == 0) stride = (size_t)m_Width * m_Channels;
+
+            // worst case is a run left over from the previous row (1 byte, flushed before the first pixel) plus 5 bytes per pixel
+            // (QOI_OP_RGBA)
+            m_Out.resize((size_t)m_Width * 5 + 1);
+
+            for (uint32_t r = 0; r < count; r++) {
+                const uint8_t* src = (const uint8_t*)rows + r * stride;
+                uint8_t*       out = m_Out.data();
+
+                for (uint32_t x = 0; x < m_Width; x++) {
+                    const uint8_t* p  = src + (size_t)x * m_Channels;
+                    Pixel          px = {p[0], p[1], p[2], m_Channels == 4 ? p[3] : (uint8_t)255};
+
+                    if (px == m_Prev) {
+                        if (++m_Run == 62) {
+                            *out++ = OP_RUN | (m_Run - 1);
+                            m_Run  = 0;
+                        }
+                        continue;
+                    }
+
+                    if (m_Run > 0) {
+                        *out++ = OP_RUN | (m_Run - 1);
+                        m_Run  = 0;
+                    }
+
+                    uint8_t hash = (uint8_t)((px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64);
+                    if (m_Index[hash] == px) {
+                        *out++ = OP_INDEX | hash;
+                    } else {
+                        m_Index[hash] = px;
+
+                        if (px[3] == m_Prev[3]) {
+                            int8_t dr = (int8_t)(px[0] - m_Prev[0]);
+                            int8_t dg = (int8_t)(px[1] - m_Prev[1]);
+                            int8_t db = (int8_t)(px[2] - m_Prev[2]);
+
+                            int8_t drdg = (int8_t)(dr - dg);
+                            int8_t dbdg = (int8_t)(db - dg);
+
+                            if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                                *out++ = OP_DIFF | (uint8_t)((dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                            } else if (drdg > -9 && drdg < 8 && dg > -33 && dg < 32 && dbdg > -9 && dbdg < 8) {
+                                *out++ = OP_LUMA | (uint8_t)(dg + 32);
+                                *out++ = (uint8_t)((drdg + 8) << 4 | (dbdg + 8));
+                            } else {
+                                *out++ = OP_RGB;
+                                *out++ = px[0];
+                                *out++ = px[1];
+                                *out++ = px[2];
+                            }
+                        } else {
+                            *out++ = OP_RGBA;
+                            *out++ = px[0];
+                            *out++ = px[1];
+                            *out++ = px[2];
+                            *out++ = px[3];
+                        }
+                    }
+
+                    m_Prev = px;
+                }
+
+                m_File.write((const char*)m_Out.data(), out - m_Out.data());
+            }
+        };
+
+      protected:
+        void finishData() override {
+            if (m_Run > 0) {
+                uint8_t run = OP_RUN | (m_Run - 1);
+                m_File.write((const char*)&run, 1);
+                m_Run = 0;
+            }
+
+            static constexpr uint8_t END[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+            m_File.write((const char*)END, 8);
+        };
+
+      private:
+        using Pixel = std::array<uint8_t, 4>;
+
+        static constexpr uint8_t OP_INDEX = 0x00;
+        static constexpr uint8_t OP_DIFF  = 0x40;
+        static constexpr uint8_t OP_LUMA  = 0x80;
+        static constexpr uint8_t OP_RUN   = 0xc0;
+        static constexpr uint8_t OP_RGB   = 0xfe;
+        static constexpr uint8_t OP_RGBA  = 0xff;
+
+        // runs and the index carry over between writeRows calls, the stream doesn't care about row boundaries
+        std::array<Pixel, 64> m_Index;
+        Pixel                 m_Prev = {0, 0, 0, 255};
+        uint8_t               m_Run  = 0;
+        std::vector<uint8_t>  m_Out;
+    };
+
+    class PngWriter : public ImageWriter {
+      public:
+        PngWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels) : m_Writer(path, width, height, channels) {};
+
+        void writeRows(const void* rows, uint32_t count, size_t stride) override { m_Writer.writeRows(rows, count, stride); };
+        void finish() override { m_Writer.finish(); };
+
+      private:
+        PngStreamWriter m_Writer;
+    };
+} // namespace
+
+bool hasRawLayout(OutputFormat format) {
+    return format == OutputFormat::eRaw || format == OutputFormat::ePam;
+}
+
+std::string rawLayoutHeader(OutputFormat format, uint32_t width, uint32_t height, uint32_t channels, size_t alignment) {
+    if (alignment == 0) alignment = 1;
+
+    if (format == OutputFormat::eRaw) {
+        if (alignment > 1) throw std::invalid_argument("raw output has no header to pad");
+        return {};
+    }
+    if (format != OutputFormat::ePam) throw std::invalid_argument("format has no raw layout");
+
+    static constexpr const char* TUPLE_TYPES[5] = {"", "GRAYSCALE", "GRAYSCALE_ALPHA", "RGB", "RGB_ALPHA"};
+
+    std::stringstream ss;
+    ss << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH " << channels << "\nMAXVAL 255\nTUPLTYPE " << TUPLE_TYPES[channels] << '\n';
+    std::string header = ss.str();
+
+    static constexpr const char END[] = "ENDHDR\n";
+    size_t      size  = header.size() + sizeof(END) - 1;
+
+    // a comment line is at least "#\n"
+    if (size_t rem = size % alignment; rem != 0) {
+        size_t pad = alignment - rem;
+        if (pad < 2) pad += alignment;
+        header += '#';
+        header.append(pad - 2, ' ');
+        header += '\n';
+    }
+
+    return header + END;
+}
+
+OutputFormat parseOutputFormat(const std::string &name) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+    if (lower == "png") return OutputFormat::ePng;
+    if (lower == "rgba" || lower == "raw") return OutputFormat::eRaw;
+    if (lower == "pam") return OutputFormat::ePam;
+    if (lower == "ppm") return OutputFormat::ePpm;
+    if (lower == "qoi") return OutputFormat::eQoi;
+    throw std::invalid_argument("unknown output format " + name);
+}
+
+OutputFormat formatFromPath(const std::string &path) {
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos) return OutputFormat::ePng;
+
+    try {
+        return parseOutputFormat(path.substr(dot + 1));
+    } catch (const std::invalid_argument&) {
+        return OutputFormat::ePng;
+    }
+}
+
+const char *formatExtension(OutputFormat format) {
+    switch (format) {
+    case OutputFormat::eRaw:
+        return "rgba";
+    case OutputFormat::ePam:
+        return "pam";
+    case OutputFormat::ePpm:
+        return "ppm";
+    case OutputFormat::eQoi:
+        return "qoi";
+    default:
+        return "png";
+    }
+}
+
+std::unique_ptr<ImageWriter> createImageWriter(OutputFormat format, const std::string &path, uint32_t width, uint32_t height, uint32_t channels) {
+    if (channels < 1 || channels > 4) throw std::runtime_error("unsupported channel count");
+
+    switch (format) {
+    case OutputFormat::eRaw:
+        return std::make_unique<RawWriter>(path, width, height, channels);
+    case OutputFormat::ePam:
+        return std::make_unique<PamWriter>(path, width, height, channels);
+    case OutputFormat::ePpm:
+        return std::make_unique<PpmWriter>(path, width, height, channels);
+    case OutputFormat::eQoi:
+        return std::make_unique<QoiWriter>(path, width, height, channels);
+    default:
+        return std::make_unique<PngWriter>(path, width, height, channels);
+    }
+}
+
+void writeImage(OutputFormat format, const std::string &path, const void *data, uint32_t width, uint32_t height, uint32_t channels, size_t stride) {
+    if (format == OutputFormat::ePng) {
+        writePng(path, data, width, height, channels, stride);
+        return;
+    }
+
+    auto writer = createImageWriter(format, path, width, height, channels);
+    writer->writeRows(data, height, stride);
+    writer->finish();
+}
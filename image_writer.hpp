@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class OutputFormat {
+    ePng, // parallel deflate, see png_writer.hpp
+    eRaw, // bare pixels, width * channels bytes per row, no header
+    ePam, // netpbm PAM, header plus bare pixels (keeps alpha)
+    ePpm, // netpbm binary PPM, header plus rgb (alpha is dropped)
+    eQoi, // "quite ok image" format, single pass and much faster than png while still compressing
+};
+
+// accepts the file extensions: png, rgba/raw, pam, ppm, qoi. throws std::invalid_argument for anything else
+[[nodiscard]] OutputFormat parseOutputFormat(const std::string& name);
+// by extension, png when the path has none or an unknown one
+[[nodiscard]] OutputFormat formatFromPath(const std::string& path);
+[[nodiscard]] const char*  formatExtension(OutputFormat format);
+
+// true for formats that are a fixed header followed by the unmodified rows (raw and pam), which can be written in place
+// (see GraphicsContext::createMappedFile)
+[[nodiscard]] bool hasRawLayout(OutputFormat format);
+// the header of such a format. with an alignment the header is padded to a multiple of it (a comment line for pam) so the
+// pixels start aligned in the file. throws std::invalid_argument for other formats, and for raw with an alignment > 1
+[[nodiscard]] std::string rawLayoutHeader(OutputFormat format, uint32_t width, uint32_t height, uint32_t channels, size_t alignment = 1);
+
+// streams 8 bit per channel rows, top to bottom, into a file. the input has `channels` channels (1-4), writers convert
+// where the format needs it (ppm drops alpha). `rows` is not referenced once writeRows returns
+class ImageWriter {
+  public:
+    virtual ~ImageWriter() = default;
+
+    virtual void writeRows(const void* rows, uint32_t count, size_t stride) = 0;
+    // throws if rows are missing or the file couldn't be written
+    virtual void finish() = 0;
+};
+
+[[nodiscard]] std::unique_ptr<ImageWriter> createImageWriter(OutputFormat format, const std::string& path, uint32_t width, uint32_t height, uint32_t channels);
+
+// whole image in one call, `stride` 0 means tightly packed
+void writeImage(OutputFormat format, const std::string& path, const void* data, uint32_t width, uint32_t height, uint32_t channels, size_t stride = 0);
@@ -1,14 +1,14 @@
 #include "setup.hpp"
+#include "renderer.hpp"
+#include "scheduler.hpp"
 
 #include <iostream>
 
 #include <vulkan/vulkan.hpp>
 
-#include <thread>
 #include <vector>
 #include <array>
-
-#include <fstream>
+#include <sstream>
 
 #define IMAGE_SIZE 8192
 
@@ -51,247 +51,85 @@ void endRenderDocFrame() {
     if (rdoc_api) rdoc_api->EndFrameCapture(nullptr, nullptr);
 }
 
-vk::RenderPass createRenderPass(GraphicsContext* gc) {
-
-    vk::AttachmentDescription colorAttachment = {{}, vk::Format::eR8G8B8A8Unorm, vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal};
-
-    vk::AttachmentReference colorAttachmentRef = {0, vk::ImageLayout::eColorAttachmentOptimal};
-    vk::SubpassDescription subpass = {{}, vk::PipelineBindPoint::eGraphics, {}, colorAttachmentRef, {}, nullptr, {}};
-
-    vk::SubpassDependency dep = {VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eNone, vk::AccessFlagBits::eColorAttachmentWrite};
-
-    vk::RenderPassCreateInfo rpci{};
-    rpci.setAttachments(colorAttachment);
-    rpci.setSubpasses(subpass);
-    rpci.setDependencies(dep);
-
-    return gc->getDevice().createRenderPass(rpci);
-}
-
-vk::PipelineLayout createPipelineLayout(GraphicsContext* gc) {
-    vk::PipelineLayoutCreateInfo plci{};
-    return gc->getDevice().createPipelineLayout(plci);
-}
-
-vk::Pipeline createPipeline(GraphicsContext* gc, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, vk::ShaderModule vert, vk::ShaderModule frag) {
-    std::vector<vk::PipelineShaderStageCreateInfo> stages = {
-        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vert, "main"),
-        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, frag, "main"),
-    };
-
-    std::vector<vk::DynamicState> dynamicStates{};
-
-    vk::Viewport viewport{0.0f, 0.0f, (float)IMAGE_SIZE, (float)IMAGE_SIZE, 0.0f, 1.0f};
-    vk::Rect2D scissor{{0, 0}, {IMAGE_SIZE, IMAGE_SIZE}};
-
-    vk::PipelineVertexInputStateCreateInfo vertexInput{};
-    vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.primitiveRestartEnable = false;
-    inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
-
-    vk::PipelineViewportStateCreateInfo viewportState{};
-    viewportState.setViewports(viewport).setScissors(scissor);
-
-    vk::PipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.depthClampEnable = false;
-    rasterizer.rasterizerDiscardEnable = false;
-    rasterizer.polygonMode = vk::PolygonMode::eFill;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.depthBiasEnable = false;
-
-    vk::PipelineMultisampleStateCreateInfo multisampler{};
-    multisampler.sampleShadingEnable = false;
-    multisampler.rasterizationSamples = vk::SampleCountFlagBits::e1;
-
-    vk::PipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-    blendAttachment.blendEnable = true;
-    blendAttachment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
-    blendAttachment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
-    blendAttachment.colorBlendOp = vk::BlendOp::eAdd;
-    blendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
-    blendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
-    blendAttachment.colorBlendOp = vk::BlendOp::eAdd;
-
-    vk::PipelineColorBlendStateCreateInfo blendState{};
-    std::array<float, 4> blend_constants = {0.0f, 0.0f, 0.0f, 0.0f};
-    blendState.setBlendConstants(blend_constants);
-    blendState.setAttachments(blendAttachment);
-    blendState.logicOpEnable = false;
-    blendState.logicOp = vk::LogicOp::eCopy;
-
-    vk::PipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.setDynamicStates(dynamicStates);
-
-    vk::GraphicsPipelineCreateInfo gpci{};
-    gpci.setStages(stages);
-    gpci.pVertexInputState = &vertexInput;
-    gpci.pInputAssemblyState = &inputAssembly;
-    gpci.pViewportState = &viewportState;
-    gpci.pRasterizationState = &rasterizer;
-    gpci.pMultisampleState = &multisampler;
-    gpci.pDepthStencilState = nullptr;
-    gpci.pColorBlendState = &blendState;
-    gpci.pDynamicState = &dynamicState;
-
-    gpci.renderPass = renderPass;
-    gpci.layout = pipelineLayout;
-    gpci.subpass = 0;
-
-    return gc->getDevice().createGraphicsPipeline(nullptr, gpci).value;
+std::array<float, 4> clearColorFor(uint64_t i) {
+    switch (i) {
+    case 1:
+        return {1.0f, 0.0f, 0.0f, 1.0f};
+    case 0:
+        return {0.0f, 1.0f, 0.0f, 1.0f};
+    case 2:
+        return {0.0f, 0.0f, 1.0f, 1.0f};
+    case 3:
+        return {1.0f, 0.0f, 1.0f, 1.0f};
+    default:
+        return {1.0f, 1.0f, 0.0f, 1.0f};
+    }
 }
 
-void doGpuThings(int i, vk::Instance instance, vk::PhysicalDevice gpu) {
-    // create a logical device
-
-    auto* gc = new GraphicsContext(instance, gpu);
-    std::cout << "Created gc" << std::endl;
-    startRenderDocFrame();
-
-    Image hostImage = gc->createImageHost(IMAGE_SIZE, IMAGE_SIZE, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eColorAttachment, vk::ImageTiling::eLinear, true);
-    Image deviceImage = gc->createImageDevice(IMAGE_SIZE, IMAGE_SIZE, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst, vk::ImageTiling::eOptimal);
-    Buffer hostBuffer = gc->createBufferHost(IMAGE_SIZE * IMAGE_SIZE * 4, vk::BufferUsageFlagBits::eTransferDst);
-
-    vk::ShaderModule vertexShader = gc->buildShaderModule("shaders/main.vert");
-    vk::ShaderModule fragmentShader = gc->buildShaderModule("shaders/main.frag");
-
-    vk::RenderPass renderPass = createRenderPass(gc);
-    vk::PipelineLayout pipelineLayout = createPipelineLayout(gc);
-    vk::Pipeline pipeline = createPipeline(gc, pipelineLayout, renderPass, vertexShader, fragmentShader);
-
-    vk::ImageView imageView = gc->createImageView(deviceImage, vk::Format::eR8G8B8A8Unorm);
-    vk::Framebuffer framebuffer = gc->createFramebuffer(renderPass, imageView, {IMAGE_SIZE, IMAGE_SIZE});
-
-    std::cout << "Begin" << std::endl;
-    gc->runCommands([&](const vk::CommandBuffer& cmd) {
-        vk::ClearColorValue clearColor;
-        switch (i) {
-        case 1:
-            clearColor = vk::ClearColorValue(1.0f, 0.0f, 0.0f, 1.0f);
-            break;
-        case 0:
-            clearColor = vk::ClearColorValue(0.0f, 1.0f, 0.0f, 1.0f);
-            break;
-        case 2:
-            clearColor = vk::ClearColorValue(0.0f, 0.0f, 1.0f, 1.0f);
-            break;
-        case 3:
-            clearColor = vk::ClearColorValue(1.0f, 0.0f, 1.0f, 1.0f);
-            break;
-        default:
-            clearColor = vk::ClearColorValue(1.0f, 1.0f, 0.0f, 1.0f);
-            break;
-        }
-
-        std::array<vk::ClearValue, 1> clearValues = {clearColor};
-
-        cmd.beginRenderPass(vk::RenderPassBeginInfo(renderPass, framebuffer, vk::Rect2D({0, 0}, {IMAGE_SIZE, IMAGE_SIZE}), clearValues), vk::SubpassContents::eInline);
-        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-        cmd.draw(3, 1, 0, 0);
-        cmd.endRenderPass();
-    });
-
-    std::cout << "Render done" << std::endl;
-
-    gc->runCommands([&](const vk::CommandBuffer& cmd) {
-        vk::ImageMemoryBarrier imb{};
-        imb.oldLayout = vk::ImageLayout::eUndefined;
-        imb.newLayout = vk::ImageLayout::eTransferDstOptimal;
-        imb.srcAccessMask = vk::AccessFlagBits::eNone;
-        imb.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-        imb.image = hostImage.image;
-        imb.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-
-        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imb);
-
-        vk::ImageCopy region;
-        region.srcOffset = vk::Offset3D{0, 0, 0};
-        region.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-        region.extent = vk::Extent3D(IMAGE_SIZE, IMAGE_SIZE, 1);
-        region.dstOffset = vk::Offset3D{0, 0, 0};
-        region.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-
-        cmd.copyImage(deviceImage.image, vk::ImageLayout::eTransferSrcOptimal, hostImage.image, vk::ImageLayout::eTransferDstOptimal, region);
-
-        vk::ImageMemoryBarrier imb4{};
-        imb4.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-        imb4.newLayout = vk::ImageLayout::eTransferSrcOptimal;
-        imb4.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        imb4.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-        imb4.image = hostImage.image;
-        imb4.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imb4);
-
-        vk::BufferImageCopy region2;
-        region2.imageOffset = vk::Offset3D{0, 0, 0};
-        region2.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-        region2.imageExtent = vk::Extent3D(IMAGE_SIZE, IMAGE_SIZE, 1);
-        region2.bufferOffset = 0;
-        region2.bufferRowLength = 0;
-        region2.bufferImageHeight = 0;
-
-        cmd.copyImageToBuffer(hostImage.image, vk::ImageLayout::eTransferSrcOptimal, hostBuffer.buffer, region2);
-    });
-
-    std::stringstream ss;
-    ss << "test" << i << ".png";
-    std::string path = ss.str();
-
-    gc->getDevice().waitIdle();
-
-//    void* mapped = gc->mapBuffer(hostBuffer);
-//    std::ofstream fi("out.hex", std::ios::binary | std::ios::out);
-//    fi.write((const char*)mapped, IMAGE_SIZE * IMAGE_SIZE * 4);
-//    fi.close();
-//    gc->unmapBuffer(hostBuffer);
-
-    gc->saveBufferImage(path, hostBuffer, IMAGE_SIZE, IMAGE_SIZE, 4, 4);
-    endRenderDocFrame();
-
-    std::cout << "Done\n";
-
-    // sleep(15);
+int main(int argc, char** argv) {
+    std::cout << "Hello!" << std::endl;
 
-    gc->destroy(framebuffer);
-    gc->destroy(imageView);
-    gc->destroy(pipeline);
-    gc->destroy(pipelineLayout);
-    gc->destroy(renderPass);
-    gc->destroy(vertexShader);
-    gc->destroy(fragmentShader);
-    gc->destroy(deviceImage);
-    gc->destroy(hostImage);
-    gc->destroy(hostBuffer);
+    ContextProfile profile = profileFromEnvironment();
 
-    delete gc;
-}
+    InstanceConfig instanceConfig{};
+    instanceConfig.profile = profile;
 
-int main() {
-    std::cout << "Hello!" << std::endl;
+    DeviceConfig deviceConfig{};
+    deviceConfig.profile = profile;
 
-    auto instance = createInstance();
+    auto instance = createInstance(instanceConfig);
+    vk::DebugUtilsMessengerEXT messenger = profile == ContextProfile::eDebug ? createDebugMessenger(instance) : nullptr;
     setup_renderdoc_support();
 
-    std::vector<std::thread> threads;
+    std::vector<vk::PhysicalDevice> gpus;
 
     size_t i = 0;
     auto physicalDevices = instance.enumeratePhysicalDevices();
     for (auto gpu : physicalDevices) {
-        int i_ = i;
         printGpuInfo(i, gpu);
         vk::PhysicalDeviceProperties p = gpu.getProperties();
         if (p.deviceType != vk::PhysicalDeviceType::eDiscreteGpu) {
             std::cout << p.deviceName.data() << " is not a real gpu :(\n";
             continue;
         }
-        threads.push_back(std::thread(doGpuThings, i_, instance, gpu));
+        gpus.push_back(gpu);
     }
-    
-    // wait for threads to end
-    for (auto& t : threads) {
-        t.join();
+
+    if (gpus.empty()) {
+        std::cerr << "No discrete gpus found, nothing to render on" << std::endl;
+        destroyDebugMessenger(instance, messenger);
+        instance.destroy();
+        return 1;
     }
 
+    // one job per gpu unless told otherwise. sizes past the device limit are rendered tiled
+    size_t   jobCount = argc > 1 ? std::stoull(argv[1]) : gpus.size();
+    uint32_t size     = argc > 2 ? (uint32_t)std::stoul(argv[2]) : IMAGE_SIZE;
+    // png, qoi, pam, ppm or rgba. the uncompressed ones are mostly disk bandwidth, qoi is a cheap middle ground
+    OutputFormat format = argc > 3 ? parseOutputFormat(argv[3]) : OutputFormat::ePng;
+    // draws of the triangle per job, enough of them and they're recorded in parallel secondary command buffers
+    uint32_t draws = argc > 4 ? (uint32_t)std::stoul(argv[4]) : 1;
+
+    startRenderDocFrame();
+    {
+        JobScheduler scheduler(instance, gpus, deviceConfig, [](GraphicsContext& gc) { return std::make_unique<Renderer>(gc); });
+
+        for (size_t j = 0; j < jobCount; j++) {
+            std::stringstream ss;
+            ss << "test" << j << '.' << formatExtension(format);
+
+            RenderJob job{j, ss.str(), size, size, clearColorFor(j)};
+            job.format    = format;
+            job.drawCount = draws;
+            scheduler.submit(job);
+        }
+
+        scheduler.finish();
+        scheduler.report();
+    }
+    endRenderDocFrame();
+
+    destroyDebugMessenger(instance, messenger);
     instance.destroy();
 
     return 0;
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// bounded lock-free multi producer / multi consumer queue (dmitry vyukov's array queue).
+// every cell carries a sequence number that tells producers and consumers whose turn it is, so a push or pop is one cas on
+// the shared index plus one store on the cell. capacity must be a power of two.
+template<typename T>
+class MpmcQueue {
+  public:
+    explicit MpmcQueue(size_t capacity) : m_Cells(new Cell[capacity]), m_Mask(capacity - 1) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) throw std::invalid_argument("MpmcQueue capacity must be a power of two");
+
+        for (size_t i = 0; i < capacity; i++) {
+            m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    };
+
+    MpmcQueue(const MpmcQueue&)            = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // `value` is only moved from when the push succeeds
+    bool tryPush(T&& value) {
+        Cell*  cell;
+        size_t pos = m_Enqueue.load(std::memory_order_relaxed);
+        while (true) {
+            cell          = &m_Cells[pos & m_Mask];
+            size_t   seq  = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_Enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_Enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    };
+
+    bool tryPop(T& out) {
+        Cell*  cell;
+        size_t pos = m_Dequeue.load(std::memory_order_relaxed);
+        while (true) {
+            cell          = &m_Cells[pos & m_Mask];
+            size_t   seq  = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_Dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_Dequeue.load(std::memory_order_relaxed);
+            }
+        }
+
+        out = std::move(cell->data);
+        cell->sequence.store(pos + m_Mask + 1, std::memory_order_release);
+        return true;
+    };
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   data;
+    };
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]>          m_Cells;
+    size_t                           m_Mask;
+    alignas(CACHE_LINE) std::atomic<size_t> m_Enqueue = 0;
+    alignas(CACHE_LINE) std::atomic<size_t> m_Dequeue = 0;
+};
@@ -0,0 +1,230 @@
+#include "png_writer.hpp"
+#include "thread_pool.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    struct CompressedBand {
+        std::vector<uint8_t> data;
+        uLong                adler;    // adler-32 of the filtered (uncompressed) band
+        uLong                crc;      // crc-32 of `data`
+        size_t               rawBytes; // size of the filtered band
+    };
+
+    uint8_t paeth(int a, int b, int c) {
+        int p  = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return (uint8_t)a;
+        if (pb <= pc) return (uint8_t)b;
+        return (uint8_t)c;
+    }
+
+    // filters one row with every png filter type and keeps the one with the lowest sum of absolute (signed) values,
+    // the same heuristic libpng and stb use. `prev` is nullptr for the first row of the image.
+    void filterRow(uint8_t* out, const uint8_t* row, const uint8_t* prev, size_t rowBytes, uint32_t bpp, std::vector<uint8_t>& scratch) {
+        scratch.resize(rowBytes);
+
+        uint32_t bestSum = UINT32_MAX;
+
+        for (uint8_t filter = 0; filter < 5; filter++) {
+            uint32_t sum = 0;
+            for (size_t x = 0; x < rowBytes; x++) {
+                int a = x >= bpp ? row[x - bpp] : 0;
+                int b = prev ? prev[x] : 0;
+                int c = (prev && x >= bpp) ? prev[x - bpp] : 0;
+
+                uint8_t v;
+                switch (filter) {
+                case 0:
+                    v = row[x];
+                    break;
+                case 1:
+                    v = row[x] - a;
+                    break;
+                case 2:
+                    v = row[x] - b;
+                    break;
+                case 3:
+                    v = row[x] - ((a + b) >> 1);
+                    break;
+                default:
+                    v = row[x] - paeth(a, b, c);
+                    break;
+                }
+
+                scratch[x] = v;
+                sum += (uint32_t)std::abs((int8_t)v);
+            }
+
+            if (sum < bestSum) {
+                bestSum = sum;
+                out[0]  = filter;
+                memcpy(out + 1, scratch.data(), rowBytes);
+            }
+        }
+    }
+
+    // `prev` is the row above rows[0], nullptr for the first row of the image
+    CompressedBand compressBand(const uint8_t* rows, size_t stride, const uint8_t* prev, size_t rowBytes, uint32_t bpp, uint32_t rowCount, bool last, int level) {
+        std::vector<uint8_t> filtered(rowCount * (rowBytes + 1));
+        std::vector<uint8_t> scratch;
+
+        for (uint32_t r = 0; r < rowCount; r++) {
+            const uint8_t* row   = rows + r * stride;
+            const uint8_t* above = r > 0 ? row - stride : prev;
+            filterRow(filtered.data() + r * (rowBytes + 1), row, above, rowBytes, bpp, scratch);
+        }
+
+        z_stream zs{};
+        // negative window bits = raw deflate, the zlib header and trailer are written once for the whole image
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+
+        CompressedBand band;
+        band.data.resize(deflateBound(&zs, filtered.size()) + 16);
+
+        zs.next_in   = filtered.data();
+        zs.avail_in  = (uInt)filtered.size();
+        zs.next_out  = band.data.data();
+        zs.avail_out = (uInt)band.data.size();
+
+        int res = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if ((last && res != Z_STREAM_END) || (!last && res != Z_OK) || zs.avail_in != 0) {
+            deflateEnd(&zs);
+            throw std::runtime_error("deflate failed");
+        }
+
+        band.data.resize(band.data.size() - zs.avail_out);
+        deflateEnd(&zs);
+
+        band.adler    = adler32(adler32(0, nullptr, 0), filtered.data(), (uInt)filtered.size());
+        band.crc      = crc32(crc32(0, nullptr, 0), band.data.data(), (uInt)band.data.size());
+        band.rawBytes = filtered.size();
+        return band;
+    }
+
+    void writeU32(std::ofstream& f, uint32_t v) {
+        uint8_t b[4] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+        f.write((const char*)b, 4);
+    }
+
+    uLong typeCrc(const char* type) {
+        return crc32(crc32(0, nullptr, 0), (const Bytef*)type, 4);
+    }
+
+    void writeChunk(std::ofstream& f, const char* type, const uint8_t* data, uint32_t size) {
+        writeU32(f, size);
+        f.write(type, 4);
+        if (size > 0) f.write((const char*)data, size);
+        writeU32(f, size > 0 ? (uint32_t)crc32(typeCrc(type), data, size) : (uint32_t)typeCrc(type));
+    }
+
+    // writes a chunk whose payload crc was already computed off-thread
+    void writeChunk(std::ofstream& f, const char* type, const std::vector<uint8_t>& data, uLong dataCrc) {
+        writeU32(f, (uint32_t)data.size());
+        f.write(type, 4);
+        f.write((const char*)data.data(), (std::streamsize)data.size());
+        writeU32(f, (uint32_t)crc32_combine(typeCrc(type), dataCrc, (z_off_t)data.size()));
+    }
+} // namespace
+
+PngStreamWriter::PngStreamWriter(const std::string &path, uint32_t width, uint32_t height, uint32_t channels, const PngOptions &options)
+    : m_Path(path), m_Width(width), m_Height(height), m_Channels(channels), m_RowBytes((size_t)width * channels), m_Options(options), m_Adler(adler32(0, nullptr, 0)) {
+    static constexpr uint8_t COLOR_TYPES[5] = {0, 0, 4, 2, 6};
+    if (channels < 1 || channels > 4) throw std::runtime_error("png: unsupported channel count");
+
+    m_File.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_File) throw std::runtime_error("png: failed to open " + path);
+
+    static constexpr uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    m_File.write((const char*)SIGNATURE, 8);
+
+    uint8_t ihdr[13] = {
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width, (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, COLOR_TYPES[channels], 0, 0, 0,
+    };
+    writeChunk(m_File, "IHDR", ihdr, 13);
+
+    // zlib header (deflate, 32k window, default level). valid since (0x78 * 256 + 0x9C) % 31 == 0
+    static constexpr uint8_t ZLIB_HEADER[2] = {0x78, 0x9C};
+    writeChunk(m_File, "IDAT", ZLIB_HEADER, 2);
+}
+
+void PngStreamWriter::writeRows(const void *rows, uint32_t count, size_t stride) {
+    if (stride == 0) stride = m_RowBytes;
+    count = std::min(count, m_Height - m_RowsWritten);
+    if (count == 0) return;
+
+    ThreadPool& pool        = m_Options.pool ? *m_Options.pool : ThreadPool::shared();
+    uint32_t    bandRows    = (uint32_t)std::clamp<size_t>(m_Options.bandBytes / std::max<size_t>(m_RowBytes, 1), 1, count);
+    uint32_t    bandCount   = (count + bandRows - 1) / bandRows;
+    size_t      maxInFlight = pool.size() * 2;
+
+    const auto* pixels = (const uint8_t*)rows;
+    const auto* prev   = m_RowsWritten > 0 ? m_PrevRow.data() : nullptr;
+
+    // bands are written strictly in order, at most maxInFlight of them are compressed (and held in memory) at once
+    std::deque<std::future<CompressedBand>> inFlight;
+    uint32_t                                nextBand = 0;
+
+    while (nextBand < bandCount || !inFlight.empty()) {
+        while (nextBand < bandCount && inFlight.size() < maxInFlight) {
+            uint32_t       firstRow = nextBand * bandRows;
+            uint32_t       n        = std::min(bandRows, count - firstRow);
+            bool           last     = m_RowsWritten + firstRow + n == m_Height;
+            const uint8_t* bandData = pixels + firstRow * stride;
+            const uint8_t* above    = firstRow > 0 ? bandData - stride : prev;
+            size_t         rowBytes = m_RowBytes;
+            uint32_t       bpp      = m_Channels;
+            int            level    = m_Options.compressionLevel;
+            inFlight.push_back(pool.submit([=]() { return compressBand(bandData, stride, above, rowBytes, bpp, n, last, level); }));
+            nextBand++;
+        }
+
+        CompressedBand band;
+        try {
+            band = inFlight.front().get();
+        } catch (...) {
+            // the remaining bands still read from `rows`, don't hand control back to the caller before they're done
+            for (auto& fut : inFlight) fut.wait();
+            throw;
+        }
+        inFlight.pop_front();
+
+        m_Adler = adler32_combine(m_Adler, band.adler, (z_off_t)band.rawBytes);
+        writeChunk(m_File, "IDAT", band.data, band.crc);
+    }
+
+    const uint8_t* lastRow = pixels + (size_t)(count - 1) * stride;
+    m_PrevRow.assign(lastRow, lastRow + m_RowBytes);
+    m_RowsWritten += count;
+}
+
+void PngStreamWriter::finish() {
+    if (m_RowsWritten != m_Height) throw std::runtime_error("png: " + m_Path + " is missing rows");
+
+    uint8_t trailer[4] = {(uint8_t)(m_Adler >> 24), (uint8_t)(m_Adler >> 16), (uint8_t)(m_Adler >> 8), (uint8_t)m_Adler};
+    writeChunk(m_File, "IDAT", trailer, 4);
+    writeChunk(m_File, "IEND", nullptr, 0);
+
+    m_File.flush();
+    if (!m_File) throw std::runtime_error("png: failed to write " + m_Path);
+    m_File.close();
+}
+
+void writePng(const std::string &path, const void *data, uint32_t width, uint32_t height, uint32_t channels, size_t stride, const PngOptions &options) {
+    PngStreamWriter writer(path, width, height, channels, options);
+    writer.writeRows(data, height, stride);
+    writer.finish();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// 8 bit per channel png writer that filters and deflates row bands in parallel.
+// every band is deflated on its own and ended with a sync flush (the last one with a finish), so the bands
+// concatenate into one valid zlib stream. the adler-32 of the stream and the crc of every IDAT chunk are
+// combined from the per band values, nothing is hashed twice.
+struct PngOptions {
+    int         compressionLevel = 6;       // zlib level, 1 = fastest, 9 = smallest
+    size_t      bandBytes        = 2 << 20; // uncompressed bytes per band (rounded to whole rows)
+    ThreadPool* pool             = nullptr; // nullptr = ThreadPool::shared()
+};
+
+// writes a png whose rows arrive in pieces (top to bottom), so the whole image never has to be in memory at once.
+// each writeRows call is split into bands and compressed in parallel like writePng.
+class PngStreamWriter {
+  public:
+    PngStreamWriter(const std::string& path, uint32_t width, uint32_t height, uint32_t channels, const PngOptions& options = {});
+
+    PngStreamWriter(const PngStreamWriter&)            = delete;
+    PngStreamWriter& operator=(const PngStreamWriter&) = delete;
+
+    // `rows` is not referenced anymore once this returns, so the caller can reuse the memory right away
+    void writeRows(const void* rows, uint32_t count, size_t stride = 0);
+
+    // writes the stream trailer and IEND. throws if fewer than `height` rows were written
+    void finish();
+
+    [[nodiscard]] inline uint32_t rowsWritten() const noexcept { return m_RowsWritten; };
+
+  private:
+    std::string   m_Path;
+    std::ofstream m_File;
+    uint32_t      m_Width;
+    uint32_t      m_Height;
+    uint32_t      m_Channels;
+    size_t        m_RowBytes;
+    PngOptions    m_Options;
+
+    uint32_t             m_RowsWritten = 0;
+    unsigned long        m_Adler;
+    std::vector<uint8_t> m_PrevRow; // last row of the previous call, the first row of the next call is filtered against it
+};
+
+// `stride` is the distance between rows in bytes, 0 means tightly packed. throws std::runtime_error on failure.
+void writePng(const std::string& path, const void* data, uint32_t width, uint32_t height, uint32_t channels, size_t stride = 0, const PngOptions& options = {});
@@ -0,0 +1,248 @@
+#include "render_graph.hpp"
+#include "barriers.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+    // a write that doesn't care what was there before, earlier writers of the image aren't needed for it
+    bool discards(const RenderGraph::Use& use) {
+        return isWriteAccess(use.access) && use.layout == vk::ImageLayout::eUndefined;
+    }
+} // namespace
+
+RenderGraph::~RenderGraph() {
+    releaseTransients();
+}
+
+RenderGraph::Handle RenderGraph::createImage(const ImageDesc &desc, vk::RenderPass renderPass) {
+    if (desc.memory != MemoryClass::eDevice) throw std::runtime_error("render graph transients live in device memory");
+
+    Resource r{};
+    r.desc       = desc;
+    r.renderPass = renderPass;
+    m_Resources.push_back(r);
+    return (Handle)(m_Resources.size() - 1);
+}
+
+RenderGraph::Handle RenderGraph::importBuffer(Buffer &buffer) {
+    Resource r{};
+    r.buffer = &buffer;
+    m_Resources.push_back(r);
+    return (Handle)(m_Resources.size() - 1);
+}
+
+void RenderGraph::addPass(std::string name, std::vector<Use> uses, Record record) {
+    if (m_Compiled) throw std::runtime_error("render graph: pass '" + name + "' added after compile");
+
+    m_Passes.push_back({std::move(name), std::move(uses), std::move(record)});
+}
+
+void RenderGraph::compile() {
+    if (m_Compiled) return;
+
+    try {
+        cull();
+        assignLifetimes();
+        allocate();
+    } catch (...) {
+        releaseTransients();
+        throw;
+    }
+    m_Compiled = true;
+}
+
+void RenderGraph::cull() {
+    // backwards: a pass stays when it touches something outside the graph, or writes a transient a later live pass reads
+    std::unordered_set<Handle> needed;
+    std::vector<bool>          live(m_Passes.size(), false);
+
+    for (size_t p = m_Passes.size(); p-- > 0;) {
+        const Pass& pass = m_Passes[p];
+
+        for (const auto& use : pass.uses) {
+            const Resource& r = m_Resources[use.resource];
+            if (!r.isTransient() || (isWriteAccess(use.access) && needed.contains(use.resource))) live[p] = true;
+        }
+        if (!live[p]) continue;
+
+        // a discarding write ends what came before it, anything else may build on it
+        for (const auto& use : pass.uses) {
+            if (!m_Resources[use.resource].isTransient()) continue;
+
+            if (discards(use)) {
+                needed.erase(use.resource);
+            } else {
+                needed.insert(use.resource);
+            }
+        }
+    }
+
+    m_Order.clear();
+    for (size_t p = 0; p < m_Passes.size(); p++) {
+        if (live[p]) m_Order.push_back(p);
+    }
+}
+
+void RenderGraph::assignLifetimes() {
+    std::unordered_set<Handle> written;
+
+    for (size_t i = 0; i < m_Order.size(); i++) {
+        const Pass& pass = m_Passes[m_Order[i]];
+
+        for (const auto& use : pass.uses) {
+            Resource& r = m_Resources[use.resource];
+            r.first     = std::min(r.first, i);
+            r.last      = std::max(r.last, i);
+
+            if (!r.isTransient()) continue;
+            if (!isWriteAccess(use.access) && !written.contains(use.resource)) {
+                throw std::runtime_error("render graph: pass '" + pass.name + "' reads a transient image no earlier pass wrote");
+            }
+            written.insert(use.resource);
+        }
+    }
+}
+
+void RenderGraph::allocate() {
+    std::vector<Handle> transients;
+    for (Handle h = 0; h < m_Resources.size(); h++) {
+        // a transient no live pass uses doesn't get memory at all
+        if (m_Resources[h].isTransient() && m_Resources[h].first != SIZE_MAX) transients.push_back(h);
+    }
+    std::sort(transients.begin(), transients.end(), [&](Handle a, Handle b) { return m_Resources[a].first < m_Resources[b].first; });
+
+    vk::Device device = m_Gc.getDevice();
+    for (Handle h : transients) {
+        Resource& r = m_Resources[h];
+
+        vk::ImageCreateInfo ici{};
+        ici.format        = r.desc.format;
+        ici.extent        = vk::Extent3D(r.desc.extent.width, r.desc.extent.height, 1);
+        ici.arrayLayers   = 1;
+        ici.imageType     = vk::ImageType::e2D;
+        ici.initialLayout = vk::ImageLayout::eUndefined;
+        ici.mipLevels     = 1;
+        ici.usage         = r.desc.usage;
+        ici.tiling        = vk::ImageTiling::eOptimal;
+        ici.sharingMode   = vk::SharingMode::eExclusive;
+
+        r.transient.image.image  = device.createImage(ici);
+        r.transient.image.extent = ici.extent;
+        r.transient.image.format = ici.format;
+
+        vk::MemoryRequirements requirements = device.getImageMemoryRequirements(r.transient.image.image);
+        m_RequestedBytes += requirements.size;
+
+        // a slot whose last user is done before this one starts, the one that grows least when several are free
+        Slot* best = nullptr;
+        for (auto& slot : m_Slots) {
+            if (slot.last >= r.first || !(slot.requirements.memoryTypeBits & requirements.memoryTypeBits)) continue;
+
+            auto growth = [&](const Slot& s) { return requirements.size > s.requirements.size ? requirements.size - s.requirements.size : 0; };
+            if (!best || growth(slot) < growth(*best)) best = &slot;
+        }
+
+        if (!best) {
+            m_Slots.push_back({requirements});
+            best = &m_Slots.back();
+        } else {
+            best->requirements.size      = std::max(best->requirements.size, requirements.size);
+            best->requirements.alignment = std::max(best->requirements.alignment, requirements.alignment);
+            best->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+        best->last = r.last;
+        r.slot     = (uint32_t)(best - m_Slots.data());
+    }
+
+    for (auto& slot : m_Slots) {
+        slot.allocation = m_Gc.allocateDeviceMemory(slot.requirements, AllocationPriority::eRenderTarget);
+        m_AllocatedBytes += slot.requirements.size;
+    }
+
+    for (Handle h : transients) {
+        Resource&  r   = m_Resources[h];
+        vk::Result res = (vk::Result)vmaBindImageMemory(m_Gc.getAllocator(), m_Slots[r.slot].allocation, static_cast<VkImage>(r.transient.image.image));
+        if (res != vk::Result::eSuccess) throw std::runtime_error("vmaBindImageMemory failed: " + vk::to_string(res));
+
+        if (r.renderPass) {
+            r.transient.view        = m_Gc.createImageView(r.transient.image, r.desc.format);
+            r.transient.framebuffer = m_Gc.createFramebuffer(r.renderPass, r.transient.view, r.desc.extent);
+            r.transient.renderPass  = r.renderPass;
+        }
+    }
+}
+
+void RenderGraph::releaseTransients() {
+    for (auto& r : m_Resources) {
+        if (r.isTransient()) {
+            if (r.transient.framebuffer) m_Gc.destroy(r.transient.framebuffer);
+            if (r.transient.view) m_Gc.destroy(r.transient.view);
+            if (r.transient.image.image) m_Gc.destroy(r.transient.image.image);
+            r.transient = {};
+        }
+        r.first = SIZE_MAX;
+        r.last  = 0;
+        r.slot  = UINT32_MAX;
+    }
+
+    // the images are gone, the memory they shared goes last
+    for (const auto& slot : m_Slots) {
+        if (slot.allocation) m_Gc.freeAllocation(slot.allocation);
+    }
+    m_Slots.clear();
+    m_Order.clear();
+    m_AllocatedBytes = 0;
+    m_RequestedBytes = 0;
+    m_Compiled       = false;
+}
+
+void RenderGraph::execute(const vk::CommandBuffer &cmd) {
+    compile();
+
+    for (size_t i = 0; i < m_Order.size(); i++) {
+        Pass& pass = m_Passes[m_Order[i]];
+
+        BarrierBatch barriers;
+        for (const auto& use : pass.uses) {
+            Resource& r = m_Resources[use.resource];
+            if (r.buffer) {
+                barriers.use(*r.buffer, use.stage, use.access);
+                continue;
+            }
+
+            // a transient takes over its memory in whatever state the previous user left it, only the contents are undefined
+            if (r.first == i) {
+                r.transient.image.state        = m_Slots[r.slot].state;
+                r.transient.image.state.layout = vk::ImageLayout::eUndefined;
+            }
+            barriers.use(r.transient.image, use.stage, use.access, use.layout);
+        }
+        barriers.flush(cmd);
+
+        if (pass.record) pass.record(cmd);
+
+        for (const auto& use : pass.uses) {
+            Resource& r = m_Resources[use.resource];
+            if (r.buffer) continue;
+
+            if (use.leaves != vk::ImageLayout::eUndefined) r.transient.image.state = ResourceState::written(use.stage, use.access, use.leaves);
+            if (r.last == i) m_Slots[r.slot].state = r.transient.image.state;
+        }
+    }
+}
+
+RenderTarget &RenderGraph::target(Handle handle) {
+    return m_Resources[handle].transient;
+}
+
+Image &RenderGraph::image(Handle handle) {
+    return m_Resources[handle].transient.image;
+}
+
+bool RenderGraph::aliased(Handle a, Handle b) const {
+    const Resource& ra = m_Resources[a];
+    const Resource& rb = m_Resources[b];
+    return ra.isTransient() && rb.isTransient() && ra.slot != UINT32_MAX && ra.slot == rb.slot;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "setup.hpp"
+#include "resource_cache.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// a frame as a list of passes that declare the images and buffers they use and how. compile() drops passes nothing depends on,
+// works out how long every transient image lives and puts transients whose passes don't overlap into the same memory (one vma
+// allocation per slot, the images are bound into it with vmaBindImageMemory), so peak memory is the biggest set of transients alive
+// at once instead of all of them. execute() records the passes with the barriers BarrierBatch derives from the uses in between, an
+// image moving into memory another one used before waits for that one's last access.
+// passes run in the order they were added, a pass may only read a transient an earlier pass wrote. one use per resource per pass.
+// the graph owns the transients: destroy it only once the last submission that executed it completed
+class RenderGraph {
+  public:
+    using Handle = uint32_t;
+
+    struct Use {
+        Handle                  resource;
+        vk::PipelineStageFlags2 stage;
+        vk::AccessFlags2        access;
+        // images only. the layout the pass needs, eUndefined keeps the current one and discards the contents (see BarrierBatch::use)
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        // images only. the layout the pass leaves the image in when it transitions it itself, e.g. a render pass' final layout
+        vk::ImageLayout leaves = vk::ImageLayout::eUndefined;
+    };
+
+    using Record = std::function<void(const vk::CommandBuffer& cmd)>;
+
+    explicit RenderGraph(GraphicsContext& gc) : m_Gc(gc) {};
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph&)            = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // device local image that only exists inside the graph, with a view and framebuffer when `renderPass` is given
+    [[nodiscard]] Handle createImage(const ImageDesc& desc, vk::RenderPass renderPass = nullptr);
+    // a buffer owned by the caller, its tracked state carries into the graph and back out. the graph keeps the address, the
+    // object behind it may be replaced (with another buffer) between executions
+    [[nodiscard]] Handle importBuffer(Buffer& buffer);
+
+    // `record` may be empty for a pass that only needs its barriers (e.g. making a copy visible to the host)
+    void addPass(std::string name, std::vector<Use> uses, Record record);
+
+    // once every pass is added. throws when a pass reads a transient that nothing wrote before, or when the memory can't be had,
+    // in which case nothing stays allocated and a later call tries again
+    void compile();
+    // records the passes that survived compile (compiling first if needed), again for every submission that wants them
+    void execute(const vk::CommandBuffer& cmd);
+
+    // transients are only backed by memory once compiled
+    [[nodiscard]] RenderTarget& target(Handle handle);
+    [[nodiscard]] Image& image(Handle handle);
+
+    // whether compile put two transients into the same memory. work submitted outside execute() has to finish with one before it
+    // starts on the other
+    [[nodiscard]] bool aliased(Handle a, Handle b) const;
+
+    // what the transients take, and what they'd take with an allocation each
+    [[nodiscard]] inline vk::DeviceSize allocatedBytes() const noexcept { return m_AllocatedBytes; };
+    [[nodiscard]] inline vk::DeviceSize requestedBytes() const noexcept { return m_RequestedBytes; };
+
+  private:
+    struct Resource {
+        ImageDesc      desc{};
+        vk::RenderPass renderPass;
+        RenderTarget   transient{};
+        Buffer*        buffer = nullptr; // imported
+
+        // first and last live pass using it (positions in m_Order), and the slot a transient's memory comes from
+        size_t   first = SIZE_MAX;
+        size_t   last  = 0;
+        uint32_t slot  = UINT32_MAX;
+
+        [[nodiscard]] inline bool isTransient() const noexcept { return !buffer; };
+    };
+
+    struct Pass {
+        std::string      name;
+        std::vector<Use> uses;
+        Record           record;
+    };
+
+    // memory shared by transients whose lifetimes don't overlap. `state` is how the last of them to finish left it
+    struct Slot {
+        vk::MemoryRequirements requirements;
+        VmaAllocation          allocation = nullptr;
+        size_t                 last       = 0;
+        ResourceState          state;
+    };
+
+    GraphicsContext& m_Gc;
+
+    std::vector<Resource> m_Resources;
+    std::vector<Pass>     m_Passes;
+    std::vector<size_t>   m_Order; // the live passes
+    std::vector<Slot>     m_Slots;
+    bool                  m_Compiled = false;
+
+    vk::DeviceSize m_AllocatedBytes = 0;
+    vk::DeviceSize m_RequestedBytes = 0;
+
+    void cull();
+    void assignLifetimes();
+    void allocate();
+    // undoes assignLifetimes and allocate
+    void releaseTransients();
+};
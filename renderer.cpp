@@ -0,0 +1,668 @@
+#include "renderer.hpp"
+#include "barriers.hpp"
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+// uniform block of shaders/background.frag
+struct JobParameters {
+    float clearColor[4];
+};
+
+namespace {
+    ImageDesc renderTargetDesc(uint32_t width, uint32_t height) {
+        return {{width, height}, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst, MemoryClass::eDevice};
+    }
+
+    // how m_RenderPass leaves its target
+    ResourceState renderedState() {
+        return ResourceState::written(vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentWrite, vk::ImageLayout::eTransferSrcOptimal);
+    }
+} // namespace
+
+vk::RenderPass createRenderPass(GraphicsContext* gc) {
+
+    vk::AttachmentDescription colorAttachment = {{}, vk::Format::eR8G8B8A8Unorm, vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eDontCare, vk::AttachmentStoreOp::eDontCare, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal};
+
+    vk::AttachmentReference colorAttachmentRef = {0, vk::ImageLayout::eColorAttachmentOptimal};
+    vk::SubpassDescription subpass = {{}, vk::PipelineBindPoint::eGraphics, {}, colorAttachmentRef, {}, nullptr, {}};
+
+    vk::SubpassDependency dep = {VK_SUBPASS_EXTERNAL, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eNone, vk::AccessFlagBits::eColorAttachmentWrite};
+
+    vk::RenderPassCreateInfo rpci{};
+    rpci.setAttachments(colorAttachment);
+    rpci.setSubpasses(subpass);
+    rpci.setDependencies(dep);
+
+    return gc->getDevice().createRenderPass(rpci);
+}
+
+vk::PipelineLayout createPipelineLayout(GraphicsContext* gc) {
+    vk::PushConstantRange tileRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(TileTransform));
+
+    vk::PipelineLayoutCreateInfo plci{};
+    plci.setPushConstantRanges(tileRange);
+    return gc->getDevice().createPipelineLayout(plci);
+}
+
+vk::Pipeline createPipeline(GraphicsContext* gc, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, vk::ShaderModule vert, vk::ShaderModule frag, bool blend) {
+    std::vector<vk::PipelineShaderStageCreateInfo> stages = {
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, vert, "main"),
+        vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, frag, "main"),
+    };
+
+    // jobs come in any size, so viewport and scissor are set per job
+    std::vector<vk::DynamicState> dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+
+    vk::PipelineVertexInputStateCreateInfo vertexInput{};
+    vk::PipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.primitiveRestartEnable = false;
+    inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+
+    vk::PipelineViewportStateCreateInfo viewportState{};
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    vk::PipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.depthClampEnable = false;
+    rasterizer.rasterizerDiscardEnable = false;
+    rasterizer.polygonMode = vk::PolygonMode::eFill;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.depthBiasEnable = false;
+
+    vk::PipelineMultisampleStateCreateInfo multisampler{};
+    multisampler.sampleShadingEnable = false;
+    multisampler.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+    vk::PipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+    blendAttachment.blendEnable = blend;
+    blendAttachment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+    blendAttachment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+    blendAttachment.colorBlendOp = vk::BlendOp::eAdd;
+    blendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+    blendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
+    blendAttachment.colorBlendOp = vk::BlendOp::eAdd;
+
+    vk::PipelineColorBlendStateCreateInfo blendState{};
+    std::array<float, 4> blend_constants = {0.0f, 0.0f, 0.0f, 0.0f};
+    blendState.setBlendConstants(blend_constants);
+    blendState.setAttachments(blendAttachment);
+    blendState.logicOpEnable = false;
+    blendState.logicOp = vk::LogicOp::eCopy;
+
+    vk::PipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.setDynamicStates(dynamicStates);
+
+    vk::GraphicsPipelineCreateInfo gpci{};
+    gpci.setStages(stages);
+    gpci.pVertexInputState = &vertexInput;
+    gpci.pInputAssemblyState = &inputAssembly;
+    gpci.pViewportState = &viewportState;
+    gpci.pRasterizationState = &rasterizer;
+    gpci.pMultisampleState = &multisampler;
+    gpci.pDepthStencilState = nullptr;
+    gpci.pColorBlendState = &blendState;
+    gpci.pDynamicState = &dynamicState;
+
+    gpci.renderPass = renderPass;
+    gpci.layout = pipelineLayout;
+    gpci.subpass = 0;
+
+    return gc->getDevice().createGraphicsPipeline(gc->getPipelineCache(), gpci).value;
+}
+
+Renderer::Renderer(GraphicsContext &gc) : m_Gc(gc) {
+    m_VertexShader   = gc.buildShaderModule("shaders/main.vert");
+    m_FragmentShader = gc.buildShaderModule("shaders/main.frag");
+
+    m_RenderPass     = createRenderPass(&gc);
+    m_PipelineLayout = createPipelineLayout(&gc);
+    m_Pipeline       = createPipeline(&gc, m_PipelineLayout, m_RenderPass, m_VertexShader, m_FragmentShader);
+
+    m_BackgroundVertexShader   = gc.buildShaderModule("shaders/background.vert");
+    m_BackgroundFragmentShader = gc.buildShaderModule("shaders/background.frag");
+
+    vk::Device device = gc.getDevice();
+
+    vk::DescriptorSetLayoutBinding    parameterBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment);
+    vk::DescriptorSetLayoutCreateInfo dslci{};
+    dslci.setBindings(parameterBinding);
+    m_ParameterLayout = device.createDescriptorSetLayout(dslci);
+
+    vk::DescriptorPoolSize poolSize(vk::DescriptorType::eUniformBuffer, WORKLOAD_FRAMES);
+    m_DescriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo({}, WORKLOAD_FRAMES, poolSize));
+
+    vk::PipelineLayoutCreateInfo plci{};
+    plci.setSetLayouts(m_ParameterLayout);
+    m_BackgroundLayout   = device.createPipelineLayout(plci);
+    m_BackgroundPipeline = createPipeline(&gc, m_BackgroundLayout, m_RenderPass, m_BackgroundVertexShader, m_BackgroundFragmentShader, false);
+
+    std::array<vk::DescriptorSetLayout, WORKLOAD_FRAMES> layouts;
+    layouts.fill(m_ParameterLayout);
+    auto sets = device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(m_DescriptorPool, layouts));
+
+    for (uint32_t i = 0; i < WORKLOAD_FRAMES; i++) {
+        auto& frame      = m_Frames[i];
+        frame.parameters = gc.createMappedBuffer(sizeof(JobParameters), vk::BufferUsageFlagBits::eUniformBuffer);
+        frame.set        = sets[i];
+
+        vk::DescriptorBufferInfo info(frame.parameters.buffer, 0, sizeof(JobParameters));
+        device.updateDescriptorSets(vk::WriteDescriptorSet(frame.set, 0, 0, vk::DescriptorType::eUniformBuffer, {}, info), {});
+    }
+}
+
+Renderer::~Renderer() {
+    flush();
+    collectSaves(true);
+    releaseSecondaries(); // only left over when a submission threw, so nothing executes them
+    // the graphs' framebuffers belong to m_RenderPass
+    m_Tiled.graph.reset();
+    releaseFrames();
+
+    for (const auto& frame : m_Frames) {
+        m_Gc.destroy(frame.parameters);
+    }
+    m_Gc.destroy(m_DescriptorPool); // frees the sets
+    m_Gc.destroy(m_BackgroundPipeline);
+    m_Gc.destroy(m_BackgroundLayout);
+    m_Gc.destroy(m_ParameterLayout);
+    m_Gc.destroy(m_BackgroundVertexShader);
+    m_Gc.destroy(m_BackgroundFragmentShader);
+
+    m_Gc.destroy(m_Pipeline);
+    m_Gc.destroy(m_PipelineLayout);
+    m_Gc.destroy(m_RenderPass);
+    m_Gc.destroy(m_VertexShader);
+    m_Gc.destroy(m_FragmentShader);
+}
+
+void Renderer::ensureCanvas(uint32_t width, uint32_t height) {
+    ImageDesc desc = renderTargetDesc(width, height);
+    if (m_Canvas && m_CanvasDesc == desc) return;
+
+    // the old size goes first, the two never take memory at the same time
+    releaseFrames();
+
+    auto                graph    = std::make_unique<RenderGraph>(m_Gc);
+    RenderGraph&        g        = *graph;
+    RenderGraph::Handle readback = g.importBuffer(m_CanvasReadback);
+    uint32_t            frames   = useWorkloads() ? WORKLOAD_FRAMES : 1;
+
+    auto render = [&](uint32_t f) {
+        m_Frames[f].handle = g.createImage(desc, m_RenderPass);
+        g.addPass("render", {{m_Frames[f].handle, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal}}, {});
+    };
+    auto copy = [&](uint32_t f) {
+        g.addPass("readback",
+                  {{m_Frames[f].handle, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal},
+                   {readback, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite}},
+                  {});
+    };
+
+    // with overlapping readbacks a frame's copy is still running while the next frame renders, otherwise it's done before that starts
+    for (uint32_t f = 0; f < frames; f++) {
+        render(f);
+        if (!overlapReadbacks()) {
+            copy(f);
+        } else if (f > 0) {
+            copy(f - 1);
+        }
+    }
+    if (overlapReadbacks()) copy(frames - 1);
+    g.compile();
+
+    for (uint32_t f = 0; f < frames; f++) {
+        m_Frames[f].target = g.target(m_Frames[f].handle);
+    }
+    m_Canvas     = std::move(graph);
+    m_CanvasDesc = desc;
+    m_NextFrame  = 0;
+
+    std::stringstream ss;
+    ss << m_Gc.getProperties().deviceName.data() << " canvas frames: " << frames << " targets in " << (m_Canvas->allocatedBytes() >> 20) << " MiB, "
+       << (m_Canvas->requestedBytes() >> 20) << " MiB as a target each\n";
+    std::cout << ss.str() << std::flush;
+}
+
+void Renderer::releaseWorkloads() {
+    for (auto& frame : m_Frames) {
+        if (!frame.workload.cmd) continue;
+
+        m_Gc.waitForCommands(frame.workload.lastSubmit);
+        m_Gc.destroy(frame.workload);
+        frame.workload = {};
+    }
+}
+
+void Renderer::releaseFrames() {
+    releaseWorkloads();
+
+    for (auto& frame : m_Frames) {
+        m_Gc.waitForCommands(frame.lastCopy);
+        frame.target   = {};
+        frame.lastCopy = {};
+    }
+    m_Canvas.reset();
+}
+
+void Renderer::collectSaves(bool wait) {
+    for (auto it = m_PendingSaves.begin(); it != m_PendingSaves.end();) {
+        if (!wait && it->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        it = finishSave(it);
+    }
+}
+
+void Renderer::waitOldestSave() {
+    if (!m_PendingSaves.empty()) finishSave(m_PendingSaves.begin());
+}
+
+std::vector<std::future<void>>::iterator Renderer::finishSave(std::vector<std::future<void>>::iterator it) {
+    try {
+        it->get();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save image: " << e.what() << std::endl;
+    }
+    return m_PendingSaves.erase(it);
+}
+
+bool Renderer::stagingFits(size_t bytes) {
+    // a finished save hands its buffer back to the cache, reusing it costs nothing
+    if (m_Gc.resources().hasIdleBuffer(bytes, vk::BufferUsageFlagBits::eTransferDst, MemoryClass::eReadback)) return true;
+    return (double)bytes <= (double)m_Gc.memoryHeadroom().host * BUDGET_SHARE;
+}
+
+void Renderer::waitForCapacity() {
+    collectSaves(false);
+    while (!stagingFits(m_LastFrameBytes) && releaseStaging()) {
+    }
+}
+
+void Renderer::recordRender(const vk::CommandBuffer &cmd, const RenderTarget &renderTarget, const RenderJob &job, uint32_t x, uint32_t y) {
+    std::array<vk::ClearValue, 1> clearValues = {vk::ClearColorValue(job.clearColor)};
+
+    // the whole target is rendered even for edge tiles that only partially cover the canvas, the readback region crops them
+    vk::Extent2D target = {renderTarget.image.extent.width, renderTarget.image.extent.height};
+    vk::Rect2D   area({0, 0}, target);
+
+    // canvas clip space -> tile clip space: a canvas pixel p lands on tile pixel p - (x, y)
+    TileTransform transform{};
+    transform.scale[0]  = (float)job.width / (float)target.width;
+    transform.scale[1]  = (float)job.height / (float)target.height;
+    transform.offset[0] = ((float)job.width - 2.0f * (float)x) / (float)target.width - 1.0f;
+    transform.offset[1] = ((float)job.height - 2.0f * (float)y) / (float)target.height - 1.0f;
+
+    vk::RenderPassBeginInfo begin(m_RenderPass, renderTarget.framebuffer, area, clearValues);
+
+    if (job.drawCount < PARALLEL_DRAWS) {
+        cmd.beginRenderPass(begin, vk::SubpassContents::eInline);
+        recordDraws(cmd, target, transform, job.drawCount);
+        cmd.endRenderPass();
+        return;
+    }
+
+    // the draws are split into chunks recorded on the thread pool, the primary only executes them
+    uint32_t       chunks = (job.drawCount + DRAWS_PER_SECONDARY - 1) / DRAWS_PER_SECONDARY;
+    SecondaryBatch batch  = m_Gc.recordSecondaries(chunks, m_RenderPass, renderTarget.framebuffer, [&](const vk::CommandBuffer& secondary, uint32_t i) {
+        recordDraws(secondary, target, transform, std::min(DRAWS_PER_SECONDARY, job.drawCount - i * DRAWS_PER_SECONDARY));
+    });
+
+    cmd.beginRenderPass(begin, vk::SubpassContents::eSecondaryCommandBuffers);
+    cmd.executeCommands(batch.commands);
+    cmd.endRenderPass();
+
+    m_Secondaries.push_back(std::move(batch));
+}
+
+void Renderer::recordDraws(const vk::CommandBuffer &cmd, vk::Extent2D extent, const TileTransform &transform, uint32_t draws) const {
+    // secondaries inherit nothing but the render pass, so every command buffer sets up its own state
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_Pipeline);
+    cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f));
+    cmd.setScissor(0, vk::Rect2D({0, 0}, extent));
+    cmd.pushConstants<TileTransform>(m_PipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, transform);
+    for (uint32_t i = 0; i < draws; i++) {
+        cmd.draw(3, 1, 0, 0);
+    }
+}
+
+void Renderer::releaseSecondaries(const CommandTicket &lastUse) {
+    for (auto& batch : m_Secondaries) {
+        m_Gc.releaseSecondaries(batch, lastUse);
+    }
+    m_Secondaries.clear();
+}
+
+void Renderer::run(const RenderJob &job) {
+    collectSaves(false);
+
+    uint32_t maxDim     = m_Gc.getProperties().limits.maxImageDimension2D;
+    size_t   frameBytes = (size_t)job.width * job.height * 4;
+
+    // frames only need a target each while their copies overlap (see m_Canvas). the tile targets of earlier tiled jobs are dropped
+    // when this one isn't tiled and the frames of another canvas size are replaced, both count as free
+    vk::Extent2D   extent     = {job.width, job.height};
+    size_t         targets    = useWorkloads() && overlapReadbacks() ? WORKLOAD_FRAMES : 1;
+    vk::DeviceSize keptBytes  = (m_Tiled.graph ? m_Tiled.graph->allocatedBytes() : 0) + (m_Canvas ? m_Canvas->allocatedBytes() : 0);
+    bool           haveTarget = m_Canvas && m_CanvasDesc.extent == extent;
+    bool           targetFits = haveTarget || (double)(frameBytes * targets) <= (double)(m_Gc.memoryHeadroom().device + keptBytes) * BUDGET_SHARE;
+
+    if (job.tileSize != 0 || job.width > maxDim || job.height > maxDim || !targetFits) {
+        renderTiled(job);
+        return;
+    }
+    m_Tiled.graph.reset(); // tiled jobs wait for all of their strips, nothing uses it anymore
+
+    // raw and pam outputs take the copy straight into the file's pages, nothing is left to write afterwards
+    if (hasRawLayout(job.format) && m_Gc.supportsMappedFiles()) {
+        if (auto file = m_Gc.createMappedFile(job.outputPath, job.format, job.width, job.height, 4)) {
+            try {
+                m_Gc.waitForCommands(renderInto(job, *file));
+            } catch (...) {
+                m_Gc.closeMappedFile(*file);
+                throw;
+            }
+            m_Gc.closeMappedFile(*file);
+
+            std::vector<GpuTiming> timings;
+            accumulateTimings(timings);
+            reportTimings(job, timings);
+            return;
+        }
+    }
+
+    // queue behind the pending readbacks and saves until one hands back enough memory, and tile once there's nothing left to wait for
+    while (!stagingFits(frameBytes) && releaseStaging()) {
+    }
+    if (!stagingFits(frameBytes)) {
+        renderTiled(job);
+        return;
+    }
+    m_LastFrameBytes = frameBytes;
+
+    MappedBuffer  staging = m_Gc.acquireStagingBuffer(frameBytes);
+    CommandTicket ticket  = renderInto(job, staging);
+    m_Readbacks.push_back({job, staging, ticket});
+
+    if (overlapReadbacks()) {
+        // the frame's target stays busy until the copy is done, the next job renders into the other frame meanwhile
+        while (m_Readbacks.size() > 1) {
+            finishReadback();
+        }
+    } else {
+        finishReadback();
+    }
+}
+
+CommandTicket Renderer::renderInto(const RenderJob &job, Buffer &buffer) {
+    m_Gc.resetTimestamps();
+
+    // the render pass leaves the image in eTransferSrcOptimal, the copy goes to the transfer queue when the device has one
+    vk::BufferImageCopy region(0, 0, 0, STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, {job.width, job.height, 1});
+
+    if (useWorkloads()) {
+        CanvasFrame& frame = workloadFrame(job);
+
+        // the frame's previous render reads the parameters, they're rewritten once it's done
+        m_Gc.waitForCommands(frame.workload.lastSubmit);
+        JobParameters parameters{};
+        std::copy(job.clearColor.begin(), job.clearColor.end(), parameters.clearColor);
+        std::memcpy(frame.parameters.data, &parameters, sizeof(parameters));
+        m_Gc.flush(frame.parameters);
+
+        // and the target is rendered to again once the previous copies out of its memory are done (this frame's, and those of the
+        // frames sharing it), those waits stay on the gpu
+        std::vector<SubmitWait> afterCopies;
+        for (const auto& other : m_Frames) {
+            if (&other == &frame || m_Canvas->aliased(other.handle, frame.handle)) afterCopies.push_back({other.lastCopy, vk::PipelineStageFlagBits::eColorAttachmentOutput});
+        }
+        CommandTicket rendered = m_Gc.submitWorkload(frame.workload, afterCopies);
+        // the tracked state is what the recording left behind, replaying it leaves the same
+        frame.target.image.state = frame.recordedState;
+        frame.lastCopy           = m_Gc.submitReadback(rendered, frame.target.image, buffer, region, "readback");
+        return frame.lastCopy;
+    }
+
+    ensureCanvas(job.width, job.height);
+    CanvasFrame&  frame  = m_Frames[0];
+    CommandTicket ticket = m_Gc.runWithReadback(
+        [&](const vk::CommandBuffer& cmd) {
+            // the render pass starts from eUndefined, it only has to wait for whatever still reads the target
+            BarrierBatch barriers;
+            barriers.use(frame.target.image, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentWrite);
+            barriers.flush(cmd);
+
+            auto t = m_Gc.timestampScope(cmd, "render");
+            recordRender(cmd, frame.target, job, 0, 0);
+            frame.target.image.state = renderedState();
+        },
+        frame.target.image, buffer, region, "readback");
+    frame.lastCopy = ticket;
+
+    // the copy waits for the render, so its ticket covers the secondaries too
+    releaseSecondaries(ticket);
+    return ticket;
+}
+
+bool Renderer::useWorkloads() const {
+    // timestamp queries can't be baked into a workload (every job numbers them from 0 again), profiling runs record every render
+    return m_Gc.getConfig().profile == ContextProfile::eRelease;
+}
+
+Renderer::CanvasFrame &Renderer::workloadFrame(const RenderJob &job) {
+    // a new size drops the workloads with the old targets
+    ensureCanvas(job.width, job.height);
+    bool recorded = std::all_of(m_Frames.begin(), m_Frames.end(), [](const CanvasFrame& frame) { return frame.workload.cmd; });
+
+    if (!recorded || job.drawCount != m_FrameDraws) {
+        releaseWorkloads();
+        m_FrameDraws = job.drawCount;
+
+        for (auto& frame : m_Frames) {
+            frame.workload = m_Gc.recordWorkload(QueueType::eGraphics, [&](const vk::CommandBuffer& cmd) { recordWorkload(cmd, frame, job.drawCount); });
+        }
+    }
+
+    CanvasFrame& frame = m_Frames[m_NextFrame];
+    m_NextFrame        = (m_NextFrame + 1) % WORKLOAD_FRAMES;
+    return frame;
+}
+
+void Renderer::recordWorkload(const vk::CommandBuffer &cmd, CanvasFrame &frame, uint32_t draws) const {
+    vk::Extent2D                  extent = m_CanvasDesc.extent;
+    vk::Rect2D                    area({0, 0}, extent);
+    std::array<vk::ClearValue, 1> clearValues = {vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f})};
+
+    cmd.beginRenderPass(vk::RenderPassBeginInfo(m_RenderPass, frame.target.framebuffer, area, clearValues), vk::SubpassContents::eInline);
+
+    // the job's clear color, from the parameter buffer
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_BackgroundPipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_BackgroundLayout, 0, frame.set, {});
+    cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, (float)extent.width, (float)extent.height, 0.0f, 1.0f));
+    cmd.setScissor(0, area);
+    cmd.draw(3, 1, 0, 0);
+
+    // the whole canvas, so no tile offset. many draws are simply recorded inline, it only happens once
+    TileTransform transform{{1.0f, 1.0f}, {0.0f, 0.0f}};
+    recordDraws(cmd, extent, transform, draws);
+    cmd.endRenderPass();
+
+    // every replay starts over from the render pass' eUndefined, the earlier copies out of its memory are ordered by the semaphore waits
+    frame.target.image.state = renderedState();
+    m_Gc.recordReadbackRelease(cmd, frame.target.image);
+    frame.recordedState = frame.target.image.state;
+}
+
+bool Renderer::overlapReadbacks() const {
+    // timestamps are reset per job, so profiling runs keep jobs apart to get clean timings
+    return m_Gc.hasTransferQueue() && m_Gc.getConfig().profile == ContextProfile::eRelease;
+}
+
+void Renderer::finishReadback() {
+    PendingReadback readback = std::move(m_Readbacks.front());
+    m_Readbacks.pop_front();
+
+    m_Gc.waitForCommands(readback.ticket);
+
+    std::vector<GpuTiming> timings;
+    accumulateTimings(timings);
+    reportTimings(readback.job, timings);
+
+    // staging belongs to the writer from here on, it goes back to the staging pool once the file is written
+    const RenderJob& job = readback.job;
+    m_PendingSaves.push_back(m_Gc.saveBufferImageAsync(job.outputPath, readback.staging, (int)job.width, (int)job.height, 4, 4, job.format));
+}
+
+void Renderer::flush() {
+    while (!m_Readbacks.empty()) {
+        finishReadback();
+    }
+}
+
+bool Renderer::releaseStaging() {
+    if (!m_Readbacks.empty()) {
+        finishReadback();
+    } else if (!m_PendingSaves.empty()) {
+        waitOldestSave();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Renderer::renderTiled(const RenderJob &job) {
+    uint32_t maxDim   = m_Gc.getProperties().limits.maxImageDimension2D;
+    uint32_t tileSize = job.tileSize != 0 ? std::min(job.tileSize, maxDim) : maxDim;
+    size_t   rowBytes = (size_t)job.width * 4;
+
+    // tile and strip shrink to what's left of the budgets (but no further than MIN_TILE_SIZE and one row). the tile the previous tiled
+    // job kept counts as free, it's reused or replaced, and so do the canvas frames dropped below
+    MemoryHeadroom headroom  = m_Gc.memoryHeadroom();
+    vk::DeviceSize keptBytes = (m_Tiled.graph ? m_Tiled.graph->allocatedBytes() : 0) + (m_Canvas ? m_Canvas->allocatedBytes() : 0);
+    uint32_t       fitting   = (uint32_t)std::sqrt((double)(headroom.device + keptBytes) * BUDGET_SHARE / 4.0);
+    tileSize                 = std::min(tileSize, std::max(MIN_TILE_SIZE, fitting));
+
+    size_t stripBudget = std::min(STRIP_BUDGET, std::max(rowBytes, (size_t)((double)headroom.host * BUDGET_SHARE)));
+
+    uint32_t tileW = std::min(job.width, tileSize);
+    uint32_t tileH = (uint32_t)std::clamp<size_t>(stripBudget / rowBytes, 1, std::min(job.height, tileSize));
+    uint32_t tiles = (job.width + tileW - 1) / tileW;
+
+    // a render and a readback scope per tile and strip. a bigger pool replaces the old one, the readbacks still timing into it go first
+    if (!m_Gc.timestampsFit(2 * tiles)) {
+        while (!m_Readbacks.empty()) {
+            finishReadback();
+        }
+        m_Gc.reserveTimestamps(2 * tiles);
+    }
+
+    // the tiles render into the graph's targets, the whole-canvas frames can go
+    releaseFrames();
+    if (!m_Tiled.graph || m_Tiled.tileW != tileW || m_Tiled.tileH != tileH || m_Tiled.tiles != tiles) buildTiledGraph(tileW, tileH, tiles);
+
+    m_Tiled.job   = &job;
+    m_Tiled.strip = m_Gc.acquireStagingBuffer(rowBytes * tileH);
+    auto out      = createImageWriter(job.format, job.outputPath, job.width, job.height, 4);
+
+    std::vector<GpuTiming> timings;
+
+    try {
+        for (m_Tiled.y = 0; m_Tiled.y < job.height; m_Tiled.y += tileH) {
+            m_Tiled.rows = std::min(tileH, job.height - m_Tiled.y);
+
+            m_Gc.resetTimestamps();
+            CommandTicket ticket = m_Gc.recordAndSubmit([&](const vk::CommandBuffer& cmd) { m_Tiled.graph->execute(cmd); });
+            m_Gc.waitForCommands(ticket);
+            releaseSecondaries();
+            accumulateTimings(timings);
+
+            m_Gc.invalidate(m_Tiled.strip, 0, rowBytes * m_Tiled.rows);
+            out->writeRows(m_Tiled.strip.data, m_Tiled.rows, rowBytes);
+        }
+
+        out->finish();
+        reportTimings(job, timings);
+    } catch (...) {
+        m_Gc.releaseStagingBuffer(m_Tiled.strip);
+        m_Tiled.strip = {};
+        m_Tiled.job   = nullptr;
+        throw;
+    }
+
+    m_Gc.releaseStagingBuffer(m_Tiled.strip);
+    m_Tiled.strip = {};
+    m_Tiled.job   = nullptr;
+}
+
+void Renderer::buildTiledGraph(uint32_t tileW, uint32_t tileH, uint32_t tiles) {
+    // when compiling throws, m_Tiled is left without a graph and the next tiled job builds one again
+    auto                graph = std::make_unique<RenderGraph>(m_Gc);
+    RenderGraph&        g     = *graph;
+    RenderGraph::Handle strip = g.importBuffer(m_Tiled.strip);
+
+    for (uint32_t i = 0; i < tiles; i++) {
+        uint32_t            x    = i * tileW;
+        RenderGraph::Handle tile = g.createImage(renderTargetDesc(tileW, tileH), m_RenderPass);
+
+        g.addPass("render", {{tile, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal}},
+                  [this, &g, tile, x](const vk::CommandBuffer& cmd) {
+                      auto t = m_Gc.timestampScope(cmd, "render");
+                      recordRender(cmd, g.target(tile), *m_Tiled.job, x, m_Tiled.y);
+                  });
+
+        // lands the tile at its column in the strip, the strip rows are canvas rows
+        g.addPass("readback",
+                  {{tile, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal},
+                   {strip, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite}},
+                  [this, &g, tile, x, tileW](const vk::CommandBuffer& cmd) {
+                      uint32_t            cols = std::min(tileW, m_Tiled.job->width - x);
+                      auto                t    = m_Gc.timestampScope(cmd, "readback");
+                      vk::BufferImageCopy region(x * 4, m_Tiled.job->width, 0, STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, {cols, m_Tiled.rows, 1});
+                      cmd.copyImageToBuffer(g.image(tile).image, vk::ImageLayout::eTransferSrcOptimal, m_Tiled.strip.buffer, region);
+                  });
+    }
+    g.addPass("host", {{strip, vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead}}, {});
+
+    // the old tiles are idle (every strip is waited for), dropping them first keeps the peak at one set of tiles
+    m_Tiled.graph.reset();
+    g.compile();
+
+    m_Tiled.graph = std::move(graph);
+    m_Tiled.tileW = tileW;
+    m_Tiled.tileH = tileH;
+    m_Tiled.tiles = tiles;
+
+    std::stringstream ss;
+    ss << m_Gc.getProperties().deviceName.data() << " tiled strips: " << tiles << " tile targets sharing " << (m_Tiled.graph->allocatedBytes() >> 20) << " MiB\n";
+    std::cout << ss.str() << std::flush;
+}
+
+void Renderer::accumulateTimings(std::vector<GpuTiming> &totals) const {
+    for (const auto& timing : m_Gc.collectTimestamps()) {
+        auto it = std::find_if(totals.begin(), totals.end(), [&](const GpuTiming& t) { return t.label == timing.label; });
+        if (it == totals.end()) {
+            totals.push_back(timing);
+        } else {
+            it->milliseconds += timing.milliseconds;
+        }
+    }
+}
+
+void Renderer::reportTimings(const RenderJob &job, const std::vector<GpuTiming> &timings) const {
+    if (timings.empty()) return;
+
+    std::stringstream ss;
+    ss << m_Gc.getProperties().deviceName.data() << " job " << job.id << ':';
+    for (const auto& t : timings) {
+        ss << ' ' << t.label << ' ' << t.milliseconds << " ms";
+    }
+    ss << '\n';
+    std::cout << ss.str() << std::flush;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include "setup.hpp"
+#include "render_graph.hpp"
+#include "resource_cache.hpp"
+#include "scheduler.hpp"
+
+#include <array>
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
+// push constant block of shaders/main.vert
+struct TileTransform {
+    float scale[2];
+    float offset[2];
+};
+
+vk::RenderPass createRenderPass(GraphicsContext* gc);
+vk::PipelineLayout createPipelineLayout(GraphicsContext* gc);
+vk::Pipeline createPipeline(GraphicsContext* gc, vk::PipelineLayout pipelineLayout, vk::RenderPass renderPass, vk::ShaderModule vert, vk::ShaderModule frag, bool blend = true);
+
+// renders the test triangle for a job and writes it out. pipeline objects live as long as the renderer, the render targets are kept
+// around while consecutive jobs have the same size (see CanvasFrame).
+// canvases bigger than the device allows (or jobs with a tileSize) are rendered tile by tile: a strip of tiles is copied into one
+// staging buffer laid out as full canvas rows, then streamed into the png writer. the strip is a RenderGraph whose tile targets share
+// one allocation (see TiledStrip), so peak memory is one tile plus one strip, and the strip height shrinks so that the strip stays
+// within STRIP_BUDGET whatever the canvas width.
+// jobs are also tiled when the target wouldn't fit the device's memory budget, with tiles and strips shrunk to what's left of it.
+// in release, whole-canvas renders are recorded once per size and draw count and only their parameters change per job.
+class Renderer : public JobHandler {
+  public:
+    explicit Renderer(GraphicsContext& gc);
+    ~Renderer() override;
+
+    void run(const RenderJob& job) override;
+    // waits for pending readbacks and saves while the last job's staging buffer wouldn't fit the host budget
+    void waitForCapacity() override;
+    // hands the last readback to the writers, the scheduler calls it when it runs out of jobs
+    void flush() override;
+
+    static constexpr size_t STRIP_BUDGET = 256ull << 20;
+    // share of a heap's remaining budget one target or staging buffer may take, the rest is left to the driver and other processes
+    static constexpr double   BUDGET_SHARE  = 0.75;
+    static constexpr uint32_t MIN_TILE_SIZE = 256;
+    // from this many draws on, render passes execute secondary command buffers recorded in parallel, DRAWS_PER_SECONDARY each
+    static constexpr uint32_t PARALLEL_DRAWS      = 4096;
+    static constexpr uint32_t DRAWS_PER_SECONDARY = 1024;
+    static constexpr uint32_t WORKLOAD_FRAMES     = 2;
+
+  private:
+    GraphicsContext& m_Gc;
+
+    vk::ShaderModule   m_VertexShader;
+    vk::ShaderModule   m_FragmentShader;
+    vk::RenderPass     m_RenderPass;
+    vk::PipelineLayout m_PipelineLayout;
+    vk::Pipeline       m_Pipeline;
+
+    // fills the target with the job's clear color read from a uniform buffer, so the color isn't baked into a recorded render pass
+    vk::ShaderModule        m_BackgroundVertexShader;
+    vk::ShaderModule        m_BackgroundFragmentShader;
+    vk::DescriptorSetLayout m_ParameterLayout;
+    vk::DescriptorPool      m_DescriptorPool;
+    vk::PipelineLayout      m_BackgroundLayout;
+    vk::Pipeline            m_BackgroundPipeline;
+
+    // a whole-canvas render into its own target, copied out by a readback. with workloads the render is recorded once and resubmitted
+    // for every following job of the same size and draw count, only `parameters` is rewritten. the frames take turns, so one renders
+    // while the other's copy is still running. without workloads only the first frame is used
+    struct CanvasFrame {
+        RenderGraph::Handle handle = 0;
+        RenderTarget        target; // the graph's, with the state this frame's submissions left it in
+        MappedBuffer        parameters;
+        vk::DescriptorSet   set;
+        RecordedWorkload    workload;
+        ResourceState       recordedState; // the target's state at the end of the workload
+        CommandTicket       lastCopy;
+    };
+
+    std::array<CanvasFrame, WORKLOAD_FRAMES> m_Frames{};
+    uint32_t                                 m_NextFrame  = 0;
+    uint32_t                                 m_FrameDraws = 0;
+
+    // the frames' targets as graph transients, laid out in the order the frames run: while a frame's copy overlaps the next frame's
+    // render (see overlapReadbacks) each one has memory of its own, otherwise they all share one allocation. the graph is only compiled
+    // for its memory, the frames go through their own submissions (render and copy are on different queues). rebuilt per canvas size
+    std::unique_ptr<RenderGraph> m_Canvas;
+    ImageDesc                    m_CanvasDesc{};
+    Buffer                       m_CanvasReadback{}; // stands in for the jobs' readback buffers
+
+    // a strip of a tiled job: every tile renders into a target of its own and is copied to its column of the strip. a target is
+    // dead once its copy ran, so the graph puts all of them into the memory of one, as much as the single reused target took before.
+    // it's kept for the following tiled jobs with the same tile layout, the passes read the job and the strip position from here
+    struct TiledStrip {
+        std::unique_ptr<RenderGraph> graph;
+        uint32_t                     tileW = 0, tileH = 0, tiles = 0;
+
+        const RenderJob* job = nullptr;
+        MappedBuffer     strip{};
+        uint32_t         y = 0, rows = 0;
+    };
+
+    TiledStrip m_Tiled;
+
+    // a frame whose copy may still be running on the transfer queue, it's saved once the copy completed
+    struct PendingReadback {
+        RenderJob     job;
+        MappedBuffer  staging;
+        CommandTicket ticket;
+    };
+
+    // with a transfer queue one readback stays in flight, job N's copy runs while job N+1 renders
+    std::deque<PendingReadback> m_Readbacks;
+
+    // saves still being encoded/written, they overlap with the next jobs. each holds a frame sized staging buffer
+    std::vector<std::future<void>> m_PendingSaves;
+    size_t                         m_LastFrameBytes = 0;
+
+    // secondaries recorded since the last submission, handed back to the context with its ticket
+    std::vector<SecondaryBatch> m_Secondaries;
+
+    // renders the whole job in one pass and copies it into `buffer`, the ticket is the copy's
+    [[nodiscard]] CommandTicket renderInto(const RenderJob& job, Buffer& buffer);
+    [[nodiscard]] bool overlapReadbacks() const;
+    [[nodiscard]] bool useWorkloads() const;
+    // the next frame, re-recorded first when the job's size or draw count differs from the recorded ones
+    CanvasFrame& workloadFrame(const RenderJob& job);
+    void recordWorkload(const vk::CommandBuffer& cmd, CanvasFrame& frame, uint32_t draws) const;
+    // m_Canvas and the frames' targets for a canvas of this size, reports what the frames take against a target each
+    void ensureCanvas(uint32_t width, uint32_t height);
+    // waits for the frames' work and frees the workloads
+    void releaseWorkloads();
+    // releaseWorkloads, then waits for the copies and drops m_Canvas with the targets
+    void releaseFrames();
+    void finishReadback();
+    void renderTiled(const RenderJob& job);
+    // replaces m_Tiled's graph with one for `tiles` tiles per strip, and reports its memory
+    void buildTiledGraph(uint32_t tileW, uint32_t tileH, uint32_t tiles);
+    // the render pass only, the caller orders it against the target's earlier uses and updates its state
+    void recordRender(const vk::CommandBuffer& cmd, const RenderTarget& renderTarget, const RenderJob& job, uint32_t x, uint32_t y);
+    void recordDraws(const vk::CommandBuffer& cmd, vk::Extent2D extent, const TileTransform& transform, uint32_t draws) const;
+    void releaseSecondaries(const CommandTicket& lastUse = {});
+
+    // gpu time per phase, summed over every submission of the job (one per strip when tiled)
+    void accumulateTimings(std::vector<GpuTiming>& totals) const;
+    void reportTimings(const RenderJob& job, const std::vector<GpuTiming>& timings) const;
+
+    void collectSaves(bool wait);
+    void waitOldestSave();
+    // finishes the oldest readback or save so its staging memory comes back, false when nothing is pending
+    bool releaseStaging();
+    std::vector<std::future<void>>::iterator finishSave(std::vector<std::future<void>>::iterator it);
+
+    [[nodiscard]] bool stagingFits(size_t bytes);
+};
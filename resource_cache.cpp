@@ -0,0 +1,169 @@
+#include "resource_cache.hpp"
+
+#include <algorithm>
+#include <array>
+
+ResourceCache::~ResourceCache() {
+    clear();
+}
+
+Image ResourceCache::acquireImage(const ImageDesc &desc) {
+    return acquireRenderTarget(desc, nullptr).image;
+}
+
+RenderTarget ResourceCache::acquireRenderTarget(const ImageDesc &desc, vk::RenderPass renderPass) {
+    {
+        std::lock_guard lock(m_Mutex);
+        evict();
+
+        // newest first, it's the most likely to still be warm
+        for (auto it = m_Images.rbegin(); it != m_Images.rend(); ++it) {
+            if (it->desc == desc && it->target.renderPass == renderPass && m_Gc.commandsComplete(it->lastUse)) {
+                RenderTarget target = it->target;
+                m_Images.erase(std::next(it).base());
+                return target;
+            }
+        }
+    }
+
+    RenderTarget target{};
+    target.image = createImage(desc);
+    if (renderPass) {
+        target.view        = m_Gc.createImageView(target.image, desc.format);
+        target.framebuffer = m_Gc.createFramebuffer(renderPass, target.view, desc.extent);
+        target.renderPass  = renderPass;
+    }
+    return target;
+}
+
+MappedBuffer ResourceCache::acquireBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory) {
+    {
+        std::lock_guard lock(m_Mutex);
+        evict();
+
+        // smallest one that fits, so a small job doesn't hold on to a full frame sized buffer
+        auto best = m_Buffers.end();
+        for (auto it = m_Buffers.begin(); it != m_Buffers.end(); ++it) {
+            if (it->usage != usage || it->memory != memory || it->buffer.size < size || !m_Gc.commandsComplete(it->lastUse)) continue;
+            if (best == m_Buffers.end() || it->buffer.size < best->buffer.size) best = it;
+        }
+
+        if (best != m_Buffers.end()) {
+            MappedBuffer buffer = best->buffer;
+            m_Buffers.erase(best);
+            return buffer;
+        }
+    }
+
+    return createBuffer(size, usage, memory);
+}
+
+bool ResourceCache::hasIdleBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory) {
+    std::lock_guard lock(m_Mutex);
+    return std::any_of(m_Buffers.begin(), m_Buffers.end(), [&](const BufferEntry& entry) {
+        return entry.usage == usage && entry.memory == memory && entry.buffer.size >= size && m_Gc.commandsComplete(entry.lastUse);
+    });
+}
+
+void ResourceCache::releaseImage(const Image &image, const ImageDesc &desc, const CommandTicket &lastUse) {
+    RenderTarget target{};
+    target.image = image;
+    releaseRenderTarget(target, desc, lastUse);
+}
+
+void ResourceCache::releaseRenderTarget(const RenderTarget &target, const ImageDesc &desc, const CommandTicket &lastUse) {
+    std::lock_guard lock(m_Mutex);
+    m_Images.push_back({target, desc, lastUse, ++m_Releases});
+}
+
+void ResourceCache::releaseBuffer(const MappedBuffer &buffer, vk::BufferUsageFlags usage, MemoryClass memory, const CommandTicket &lastUse) {
+    std::lock_guard lock(m_Mutex);
+    m_Buffers.push_back({buffer, usage, memory, lastUse, ++m_Releases});
+}
+
+void ResourceCache::clear() {
+    std::lock_guard lock(m_Mutex);
+
+    for (const auto& entry : m_Images) {
+        destroyEntry(entry);
+    }
+    for (const auto& entry : m_Buffers) {
+        destroyEntry(entry);
+    }
+    m_Images.clear();
+    m_Buffers.clear();
+}
+
+Image ResourceCache::createImage(const ImageDesc &desc) const {
+    if (desc.memory == MemoryClass::eDevice) {
+        bool attachment = (bool)(desc.usage & (vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment));
+        auto priority   = attachment ? AllocationPriority::eRenderTarget : AllocationPriority::ePersistent;
+        return m_Gc.createImageDevice(desc.extent.width, desc.extent.height, desc.format, vk::ImageLayout::eUndefined, desc.usage, vk::ImageTiling::eOptimal, priority);
+    }
+
+    auto priority = desc.memory == MemoryClass::eReadback ? AllocationPriority::eStaging : AllocationPriority::eTransient;
+    return m_Gc.createImageHost(desc.extent.width, desc.extent.height, desc.format, vk::ImageLayout::eUndefined, desc.usage, vk::ImageTiling::eLinear, true, priority);
+}
+
+MappedBuffer ResourceCache::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory) const {
+    switch (memory) {
+    case MemoryClass::eHost:
+        return m_Gc.createMappedBuffer(size, usage);
+    case MemoryClass::eReadback:
+        return m_Gc.createReadbackBuffer(size, usage);
+    default: {
+        MappedBuffer buffer{};
+        static_cast<Buffer&>(buffer) = m_Gc.createBufferDevice(size, usage);
+        buffer.data                  = nullptr;
+        buffer.coherent              = false;
+        return buffer;
+    }
+    }
+}
+
+void ResourceCache::destroyEntry(const ImageEntry &entry) const {
+    if (entry.target.framebuffer) m_Gc.destroy(entry.target.framebuffer);
+    if (entry.target.view) m_Gc.destroy(entry.target.view);
+    m_Gc.destroy(entry.target.image);
+}
+
+void ResourceCache::destroyEntry(const BufferEntry &entry) const {
+    m_Gc.destroy(entry.buffer);
+}
+
+void ResourceCache::evict() {
+    const VkPhysicalDeviceMemoryProperties* props;
+    vmaGetMemoryProperties(m_Gc.getAllocator(), &props);
+
+    auto heapOf = [&](const VmaAllocationInfo& info) { return props->memoryTypes[info.memoryType].heapIndex; };
+
+    while (!m_Images.empty() || !m_Buffers.empty()) {
+        // vma accounts its own frees into the usage, so this follows every eviction without another driver query
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+        vmaGetHeapBudgets(m_Gc.getAllocator(), budgets.data());
+
+        bool tooMany    = m_Images.size() + m_Buffers.size() > MAX_IDLE;
+        auto overBudget = [&](uint32_t heap) { return (double)budgets[heap].usage > (double)budgets[heap].budget * EVICT_THRESHOLD; };
+
+        // oldest idle entry that is over the count limit or in a heap that's running out
+        auto image = m_Images.end();
+        for (auto it = m_Images.begin(); it != m_Images.end(); ++it) {
+            if ((tooMany || overBudget(heapOf(it->target.image.allocationInfo))) && m_Gc.commandsComplete(it->lastUse) && (image == m_Images.end() || it->releasedAt < image->releasedAt)) image = it;
+        }
+
+        auto buffer = m_Buffers.end();
+        for (auto it = m_Buffers.begin(); it != m_Buffers.end(); ++it) {
+            if ((tooMany || overBudget(heapOf(it->buffer.allocationInfo))) && m_Gc.commandsComplete(it->lastUse) && (buffer == m_Buffers.end() || it->releasedAt < buffer->releasedAt)) buffer = it;
+        }
+
+        if (image == m_Images.end() && buffer == m_Buffers.end()) break;
+
+        if (buffer == m_Buffers.end() || (image != m_Images.end() && image->releasedAt < buffer->releasedAt)) {
+            destroyEntry(*image);
+            m_Images.erase(image);
+        } else {
+            destroyEntry(*buffer);
+            m_Buffers.erase(buffer);
+        }
+    }
+}
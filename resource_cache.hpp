@@ -0,0 +1,95 @@
+#pragma once
+#include "setup.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// where an allocation lives. host images are linear and mappable, readback buffers prefer HOST_CACHED (see createReadbackBuffer)
+enum class MemoryClass {
+    eDevice,
+    eHost,
+    eReadback,
+};
+
+struct ImageDesc {
+    vk::Extent2D        extent;
+    vk::Format          format = vk::Format::eR8G8B8A8Unorm;
+    vk::ImageUsageFlags usage;
+    MemoryClass         memory = MemoryClass::eDevice;
+
+    bool operator==(const ImageDesc&) const = default;
+};
+
+// an image with a view and a framebuffer for one render pass, recycled as a unit. view and framebuffer are null for plain images
+struct RenderTarget {
+    Image           image{};
+    vk::ImageView   view;
+    vk::Framebuffer framebuffer;
+    vk::RenderPass  renderPass;
+};
+
+// recycles images (with their views and framebuffers) and buffers between jobs, so steady state work doesn't go through vma and
+// object creation for every frame. release hands an object back together with the ticket of the last submission using it, acquire
+// only returns objects whose ticket completed (and otherwise creates a new one). buffers are matched on usage and memory class and the
+// smallest one that's big enough wins.
+// idle objects are destroyed oldest first while their heap is above EVICT_THRESHOLD of its VK_EXT_memory_budget budget (vma estimates
+// the budget without the extension), and whenever more than MAX_IDLE are cached.
+// acquire and release are thread safe and may be called from any thread, tickets are checked by reading their timeline semaphore.
+class ResourceCache {
+  public:
+    explicit ResourceCache(GraphicsContext& gc) : m_Gc(gc) {};
+    ~ResourceCache();
+
+    ResourceCache(const ResourceCache&)            = delete;
+    ResourceCache& operator=(const ResourceCache&) = delete;
+
+    [[nodiscard]] Image        acquireImage(const ImageDesc& desc);
+    [[nodiscard]] RenderTarget acquireRenderTarget(const ImageDesc& desc, vk::RenderPass renderPass);
+    [[nodiscard]] MappedBuffer acquireBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory);
+
+    void releaseImage(const Image& image, const ImageDesc& desc, const CommandTicket& lastUse = {});
+    void releaseRenderTarget(const RenderTarget& target, const ImageDesc& desc, const CommandTicket& lastUse = {});
+    void releaseBuffer(const MappedBuffer& buffer, vk::BufferUsageFlags usage, MemoryClass memory, const CommandTicket& lastUse = {});
+
+    // whether acquireBuffer would hand out a cached buffer instead of allocating
+    [[nodiscard]] bool hasIdleBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory);
+
+    // destroys every idle object, in use ones are left to their owners
+    void clear();
+
+    static constexpr double EVICT_THRESHOLD = 0.8;
+    static constexpr size_t MAX_IDLE        = 32;
+
+  private:
+    struct ImageEntry {
+        RenderTarget  target;
+        ImageDesc     desc;
+        CommandTicket lastUse;
+        uint64_t      releasedAt;
+    };
+
+    struct BufferEntry {
+        MappedBuffer         buffer;
+        vk::BufferUsageFlags usage;
+        MemoryClass          memory;
+        CommandTicket        lastUse;
+        uint64_t             releasedAt;
+    };
+
+    GraphicsContext& m_Gc;
+
+    std::mutex               m_Mutex;
+    std::vector<ImageEntry>  m_Images;
+    std::vector<BufferEntry> m_Buffers;
+    uint64_t                 m_Releases = 0;
+
+    [[nodiscard]] Image createImage(const ImageDesc& desc) const;
+    [[nodiscard]] MappedBuffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryClass memory) const;
+
+    void destroyEntry(const ImageEntry& entry) const;
+    void destroyEntry(const BufferEntry& entry) const;
+
+    // needs m_Mutex
+    void evict();
+};
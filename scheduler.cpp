@@ -0,0 +1,144 @@
+#include "scheduler.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+JobScheduler::JobScheduler(vk::Instance instance, const std::vector<vk::PhysicalDevice> &gpus, const DeviceConfig &config, JobHandlerFactory factory)
+    : m_Instance(instance), m_Config(config), m_Factory(std::move(factory)) {
+    // nothing would ever take a job, finish() would wait forever
+    if (gpus.empty()) throw std::runtime_error("job scheduler needs at least one gpu");
+
+    m_Start = std::chrono::steady_clock::now();
+
+    for (auto gpu : gpus) {
+        auto worker  = std::make_unique<Worker>();
+        worker->gpu  = gpu;
+        worker->name = gpu.getProperties().deviceName.data();
+        m_Workers.push_back(std::move(worker));
+    }
+
+    m_Alive = m_Workers.size();
+
+    // start only once m_Workers is complete, workers look at each other's queues
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        m_Workers[i]->thread = std::thread(&JobScheduler::workerLoop, this, i);
+    }
+}
+
+JobScheduler::~JobScheduler() {
+    finish();
+}
+
+void JobScheduler::submit(RenderJob job, size_t device) {
+    MpmcQueue<RenderJob>& queue = device == ANY_DEVICE ? m_Shared : m_Workers[device % m_Workers.size()]->queue;
+
+    m_Submitted.fetch_add(1, std::memory_order_relaxed);
+    while (!queue.tryPush(std::move(job))) {
+        std::this_thread::yield();
+    }
+
+    m_Epoch.fetch_add(1, std::memory_order_release);
+    m_Epoch.notify_all();
+}
+
+void JobScheduler::finish() {
+    uint64_t completed = m_Completed.load(std::memory_order_acquire);
+    while (completed != m_Submitted.load(std::memory_order_acquire)) {
+        m_Completed.wait(completed);
+        completed = m_Completed.load(std::memory_order_acquire);
+    }
+
+    m_Stopping.store(true, std::memory_order_release);
+    m_Epoch.fetch_add(1, std::memory_order_release);
+    m_Epoch.notify_all();
+
+    for (auto& worker : m_Workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+bool JobScheduler::takeJob(size_t index, RenderJob &job) {
+    Worker& self = *m_Workers[index];
+    if (self.queue.tryPop(job)) return true;
+    if (m_Shared.tryPop(job)) return true;
+
+    for (size_t i = 1; i < m_Workers.size(); i++) {
+        if (m_Workers[(index + i) % m_Workers.size()]->queue.tryPop(job)) {
+            self.stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobScheduler::workerLoop(size_t index) {
+    Worker& self = *m_Workers[index];
+
+    std::unique_ptr<GraphicsContext> gc;
+    std::unique_ptr<JobHandler>      handler;
+    try {
+        gc      = std::make_unique<GraphicsContext>(m_Instance, self.gpu, m_Config);
+        handler = m_Factory(*gc);
+    } catch (const std::exception& e) {
+        // the other workers pick up the slack, jobs submitted to this device's own queue get stolen.
+        // if this was the last device standing fall through and fail every job so finish() doesn't wait forever
+        std::cerr << "Worker for " << self.name << " failed to start: " << e.what() << std::endl;
+        if (m_Alive.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    }
+
+    while (true) {
+        if (handler) handler->waitForCapacity();
+
+        uint64_t  epoch = m_Epoch.load(std::memory_order_acquire);
+        RenderJob job;
+
+        if (takeJob(index, job)) {
+            if (!handler) {
+                self.failed.fetch_add(1, std::memory_order_relaxed);
+                m_Completed.fetch_add(1, std::memory_order_release);
+                m_Completed.notify_all();
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                handler->run(job);
+                self.jobs.fetch_add(1, std::memory_order_relaxed);
+                self.pixels.fetch_add((uint64_t)job.width * job.height, std::memory_order_relaxed);
+            } catch (const std::exception& e) {
+                std::cerr << "Job " << job.id << " failed on " << self.name << ": " << e.what() << std::endl;
+                self.failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            self.busyNanos.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+
+            m_Completed.fetch_add(1, std::memory_order_release);
+            m_Completed.notify_all();
+            continue;
+        }
+
+        if (handler) handler->flush();
+        if (m_Stopping.load(std::memory_order_acquire)) break;
+
+        // nothing anywhere, sleep until the next submit (or finish). a submit between the epoch load and here changes the
+        // epoch, so the wait returns right away instead of missing it
+        m_Epoch.wait(epoch, std::memory_order_acquire);
+    }
+
+    handler.reset(); // before the context, handlers own device objects
+}
+
+void JobScheduler::report() const {
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+
+    std::cout << "==================================================\n";
+    std::cout << "Scheduler: " << m_Completed.load() << " jobs in " << std::fixed << std::setprecision(2) << wall << " s\n";
+    for (size_t i = 0; i < m_Workers.size(); i++) {
+        const Worker& w    = *m_Workers[i];
+        double        busy = (double)w.busyNanos.load() / 1e9;
+        std::cout << "Gpu #" << i << " (" << w.name << "): " << w.jobs.load() << " jobs (" << w.failed.load() << " failed, " << w.stolen.load() << " stolen), " << w.jobs.load() / wall
+                  << " jobs/s, " << (double)w.pixels.load() / 1e6 / wall << " Mpix/s, " << (wall > 0 ? 100.0 * busy / wall : 0.0) << "% busy\n";
+    }
+    std::cout << std::defaultfloat << std::flush;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "image_writer.hpp"
+#include "mpmc_queue.hpp"
+#include "setup.hpp"
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RenderJob {
+    uint64_t             id = 0;
+    std::string          outputPath;
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+    std::array<float, 4> clearColor{0.0f, 0.0f, 0.0f, 1.0f};
+    uint32_t             tileSize  = 0; // render in tiles of at most this size, 0 = only tile when the canvas exceeds maxImageDimension2D
+    OutputFormat         format    = OutputFormat::ePng;
+    uint32_t             drawCount = 1; // times the test triangle is drawn, a stand-in for scenes with many draws
+};
+
+// per device state that executes jobs, created on the worker thread once the device's GraphicsContext exists
+class JobHandler {
+  public:
+    virtual ~JobHandler() = default;
+
+    virtual void run(const RenderJob& job) = 0;
+
+    // called before the worker takes its next job, blocks until the device has the memory for more work. jobs stay queued
+    // (and can be stolen by other devices) in the meantime
+    virtual void waitForCapacity() {};
+
+    // called when the worker runs out of jobs, before it goes to sleep. finish anything held back for overlap with the next job
+    virtual void flush() {};
+};
+
+using JobHandlerFactory = std::function<std::unique_ptr<JobHandler>(GraphicsContext& gc)>;
+
+constexpr size_t ANY_DEVICE = SIZE_MAX;
+
+// spreads jobs over one long lived worker per device. jobs go into a shared lock-free queue (or a device's own queue when
+// submitted with a device index), an idle worker takes from its own queue, then the shared one, then steals from the other
+// devices' queues so a slow device never leaves a fast one idle.
+class JobScheduler {
+  public:
+    // throws when `gpus` is empty
+    JobScheduler(vk::Instance instance, const std::vector<vk::PhysicalDevice>& gpus, const DeviceConfig& config, JobHandlerFactory factory);
+    ~JobScheduler();
+
+    JobScheduler(const JobScheduler&)            = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    // blocks (yielding) while the target queue is full
+    void submit(RenderJob job, size_t device = ANY_DEVICE);
+
+    // waits for every submitted job, then stops and joins the workers
+    void finish();
+
+    // jobs, busy time and throughput per device since construction
+    void report() const;
+
+    [[nodiscard]] inline size_t deviceCount() const noexcept { return m_Workers.size(); };
+
+  private:
+    static constexpr size_t SHARED_QUEUE_CAPACITY = 4096;
+    static constexpr size_t DEVICE_QUEUE_CAPACITY = 256;
+
+    struct Worker {
+        vk::PhysicalDevice    gpu;
+        std::string           name;
+        MpmcQueue<RenderJob>  queue{DEVICE_QUEUE_CAPACITY};
+        std::thread           thread;
+        std::atomic<uint64_t> jobs      = 0;
+        std::atomic<uint64_t> failed    = 0;
+        std::atomic<uint64_t> stolen    = 0;
+        std::atomic<uint64_t> pixels    = 0;
+        std::atomic<uint64_t> busyNanos = 0;
+    };
+
+    vk::Instance                         m_Instance;
+    DeviceConfig                         m_Config;
+    JobHandlerFactory                    m_Factory;
+    MpmcQueue<RenderJob>                 m_Shared{SHARED_QUEUE_CAPACITY};
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+
+    // bumped on every submit, idle workers sleep on it
+    std::atomic<uint64_t> m_Epoch     = 0;
+    std::atomic<uint64_t> m_Submitted = 0;
+    std::atomic<uint64_t> m_Completed = 0;
+    std::atomic<bool>     m_Stopping  = false;
+    std::atomic<size_t>   m_Alive     = 0;
+
+    std::chrono::steady_clock::time_point m_Start;
+
+    void workerLoop(size_t index);
+    bool takeJob(size_t index, RenderJob& job);
+};
@@ -1,15 +1,43 @@
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb/stb_image_write.h"
-
-
 #include "setup.hpp"
+#include "image_writer.hpp"
+#include "thread_pool.hpp"
+#include "resource_cache.hpp"
+#include "disk_cache.hpp"
+#include "barriers.hpp"
 
 #include <iostream>
 
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <bit>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <fcntl.h>
+#define BS_HAS_MMAP 1
+#endif
+
+// identifies the shader compiler for the spir-v cache. shaderc has no version query, CMakeLists.txt passes a hash of the shaderc
+// library that gets linked in (and reconfigures when it changes). builds that don't pass it need to clear the cache themselves
+#ifndef SHADERC_BUILD_VERSION
+#define SHADERC_BUILD_VERSION "unknown"
+#endif
+
+// one per recording thread, see GraphicsContext::threadCommandPool. only the owning thread touches `pool` and `free`, other
+// threads hand finished buffers back through `retired`, which the owner picks up the next time it records
+struct ThreadCommandPool {
+    vk::CommandPool                pool;
+    std::vector<vk::CommandBuffer> free;
+    std::mutex                     retiredMutex;
+    std::vector<vk::CommandBuffer> retired;
+};
 
 std::string readFile(const std::string& path) {
     std::ifstream f(path, std::ios::in | std::ios::ate);
@@ -25,33 +53,107 @@ std::string readFile(const std::string& path) {
     return s;
 }
 
-vk::Instance createInstance() {
+ContextProfile profileFromEnvironment() {
+    const char* env = std::getenv("BS_PROFILE");
+    if (env == nullptr) return ContextProfile::eRelease;
+
+    std::string profile = env;
+    if (profile == "debug") return ContextProfile::eDebug;
+    if (profile == "profiling") return ContextProfile::eProfiling;
+    if (profile != "release") std::cerr << "Unknown BS_PROFILE " << profile << ", using release" << std::endl;
+    return ContextProfile::eRelease;
+}
+
+namespace {
+    bool hasName(const std::vector<vk::ExtensionProperties>& props, const char* name) {
+        return std::any_of(props.begin(), props.end(), [&](const vk::ExtensionProperties& p) { return strcmp(p.extensionName.data(), name) == 0; });
+    }
+
+    bool hasName(const std::vector<vk::LayerProperties>& props, const char* name) {
+        return std::any_of(props.begin(), props.end(), [&](const vk::LayerProperties& p) { return strcmp(p.layerName.data(), name) == 0; });
+    }
+
+    VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT* data, void*) {
+        std::cerr << "[" << vk::to_string((vk::DebugUtilsMessageSeverityFlagBitsEXT)severity) << "] " << data->pMessage << std::endl;
+        return VK_FALSE;
+    }
+
+    // first family with every flag of `want` and none of `avoid`
+    std::optional<uint32_t> findQueueFamily(const std::vector<vk::QueueFamilyProperties>& families, vk::QueueFlags want, vk::QueueFlags avoid) {
+        for (uint32_t i = 0; i < families.size(); i++) {
+            const auto& family = families[i];
+            if ((family.queueFlags & want) == want && !(family.queueFlags & avoid) && family.queueCount > 0) return i;
+        }
+        return std::nullopt;
+    }
+
+    void applyPriority(VmaAllocationCreateInfo& aci, AllocationPriority priority) {
+        switch (priority) {
+        case AllocationPriority::eRenderTarget:
+            aci.priority = 1.0f;
+            aci.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+            break;
+        case AllocationPriority::ePersistent:
+            aci.priority = 0.75f;
+            break;
+        case AllocationPriority::eTransient:
+            aci.priority = 0.5f;
+            break;
+        case AllocationPriority::eStaging:
+            aci.priority = 0.0f;
+            aci.flags |= VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+            break;
+        }
+    }
+
+} // namespace
+
+vk::Instance createInstance(const InstanceConfig& config) {
     vk::ApplicationInfo appInfo{};
     appInfo.apiVersion = vk::ApiVersion13;
 
     auto ieprops = vk::enumerateInstanceExtensionProperties();
-    for (const auto& pr : ieprops) {
-        std::cout << "- " << pr.extensionName.data() << std::endl;
-    }
-
-    std::cout << "Layers:" << std::endl;
     auto lprs = vk::enumerateInstanceLayerProperties();
-    for (const auto& pr : lprs) {
-        std::cout << "- " << pr.layerName.data() << std::endl;
-    }
 
-    auto instv = vk::enumerateInstanceVersion();
-    std::cout << "Instance Version: " << vk::apiVersionMajor(instv) << '.' << vk::apiVersionMinor(instv) << '.' << vk::apiVersionPatch(instv) << std::endl;
+    bool debug = config.profile == ContextProfile::eDebug;
+    if (debug) {
+        for (const auto& pr : ieprops) {
+            std::cout << "- " << pr.extensionName.data() << std::endl;
+        }
 
-    std::vector<const char*> iextensions = {
-        "VK_KHR_device_group_creation",
-        "VK_KHR_get_physical_device_properties2",
-        "VK_EXT_debug_utils",
-    };
+        std::cout << "Layers:" << std::endl;
+        for (const auto& pr : lprs) {
+            std::cout << "- " << pr.layerName.data() << std::endl;
+        }
 
-    std::vector<const char*> layers = {
-        "VK_LAYER_KHRONOS_validation"
-    };
+        auto instv = vk::enumerateInstanceVersion();
+        std::cout << "Instance Version: " << vk::apiVersionMajor(instv) << '.' << vk::apiVersionMinor(instv) << '.' << vk::apiVersionPatch(instv) << std::endl;
+    }
+
+    std::vector<const char*> iextensions = config.extensions;
+    std::vector<const char*> layers = config.layers;
+
+    if (debug) {
+        // debugging aids are best effort, a machine without the sdk still runs
+        if (hasName(ieprops, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)) {
+            iextensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        } else {
+            std::cerr << VK_EXT_DEBUG_UTILS_EXTENSION_NAME << " not available, no debug messenger" << std::endl;
+        }
+
+        if (hasName(lprs, "VK_LAYER_KHRONOS_validation")) {
+            layers.push_back("VK_LAYER_KHRONOS_validation");
+        } else {
+            std::cerr << "VK_LAYER_KHRONOS_validation not available, running without validation" << std::endl;
+        }
+    }
+
+    for (const char* ext : iextensions) {
+        if (!hasName(ieprops, ext)) throw std::runtime_error(std::string("Missing instance extension ") + ext);
+    }
+    for (const char* layer : layers) {
+        if (!hasName(lprs, layer)) throw std::runtime_error(std::string("Missing instance layer ") + layer);
+    }
 
     vk::InstanceCreateInfo ici{};
     ici.setPEnabledExtensionNames(iextensions);
@@ -61,6 +163,28 @@ vk::Instance createInstance() {
     return vk::createInstance(ici);
 }
 
+vk::DebugUtilsMessengerEXT createDebugMessenger(vk::Instance instance) {
+    auto create = (PFN_vkCreateDebugUtilsMessengerEXT)instance.getProcAddr("vkCreateDebugUtilsMessengerEXT");
+    if (create == nullptr) return nullptr; // instance made without debug utils
+
+    vk::DebugUtilsMessengerCreateInfoEXT ci{};
+    ci.messageSeverity = vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning | vk::DebugUtilsMessageSeverityFlagBitsEXT::eError;
+    ci.messageType = vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral | vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation | vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance;
+    ci.pfnUserCallback = debugCallback;
+
+    VkDebugUtilsMessengerCreateInfoEXT ci_ = ci;
+    VkDebugUtilsMessengerEXT messenger = VK_NULL_HANDLE;
+    create(instance, &ci_, nullptr, &messenger);
+    return messenger;
+}
+
+void destroyDebugMessenger(vk::Instance instance, vk::DebugUtilsMessengerEXT messenger) {
+    if (!messenger) return;
+
+    auto destroy = (PFN_vkDestroyDebugUtilsMessengerEXT)instance.getProcAddr("vkDestroyDebugUtilsMessengerEXT");
+    if (destroy) destroy(instance, messenger, nullptr);
+}
+
 void printGpuInfo(size_t& i, vk::PhysicalDevice gpu) {
     std::cout << "==================================================\n";
     auto props = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDevicePCIBusInfoPropertiesEXT>();
@@ -72,7 +196,7 @@ void printGpuInfo(size_t& i, vk::PhysicalDevice gpu) {
     std::cout << "Device Id: " << pr2.properties.deviceID << '\n';
 }
 
-GraphicsContext::GraphicsContext(vk::Instance instance, vk::PhysicalDevice gpu) : m_Instance(instance), m_Gpu(gpu) {
+GraphicsContext::GraphicsContext(vk::Instance instance, vk::PhysicalDevice gpu, const DeviceConfig& config) : m_Instance(instance), m_Gpu(gpu), m_Config(config) {
     auto props = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDevicePCIBusInfoPropertiesEXT>();
     m_GpuProperties = props.get<vk::PhysicalDeviceProperties2>();
     m_GpuPciInfo = props.get<vk::PhysicalDevicePCIBusInfoPropertiesEXT>();
@@ -86,12 +210,41 @@ GraphicsContext::GraphicsContext(vk::Instance instance, vk::PhysicalDevice gpu)
     createAllocator();
     std::cout << "created allocator" << std::endl;
 
-    m_Pool = m_Device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, 0));
+    m_Pool = m_Device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, getQueueFamily(QueueType::eGraphics)));
     std::cout << "created pool" << std::endl;
+
+    createCommandRings();
+    createPipelineCache();
+    createTimestampPool();
+
+    m_Resources = std::make_unique<ResourceCache>(*this);
+
+    // encoding is spread over ThreadPool::shared() by the png writer, these threads mostly wait on it and on disk
+    m_Writers = std::make_unique<ThreadPool>(2);
 }
 
 GraphicsContext::~GraphicsContext() {
+    m_Writers.reset(); // drains pending saves, which still use their staging buffers
+
     m_Device.waitIdle();
+    m_Resources.reset();
+
+    m_RetiredBatches.clear();
+    for (const auto& [thread, state] : m_ThreadPools) {
+        m_Device.destroy(state->pool); // frees its secondaries, handed back or not
+    }
+    m_ThreadPools.clear();
+
+    savePipelineCache();
+    m_Device.destroy(m_PipelineCache);
+    if (m_TimestampPool) m_Device.destroy(m_TimestampPool);
+
+    for (const auto& ring : m_Rings) {
+        m_Device.destroy(ring.pool); // frees the ring's command buffers
+    }
+    for (const auto& timeline : m_Timelines) {
+        m_Device.destroy(timeline);
+    }
 
     m_Device.destroy(m_Pool);
     vmaDestroyAllocator(m_Allocator);
@@ -100,29 +253,81 @@ GraphicsContext::~GraphicsContext() {
 
 void GraphicsContext::createDevice() {
     auto exts = m_Gpu.enumerateDeviceExtensionProperties();
-    for (const auto& e : exts) {
-        std::cout << e.extensionName << std::endl;
-    }
-
-    std::vector<const char*> extensions = {
-//        VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
-//        VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
-//        VK_KHR_MAINTENANCE_4_EXTENSION_NAME,
-//        VK_KHR_MAINTENANCE_5_EXTENSION_NAME,
-        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
-//        VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
-        VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME,
-    };
+    if (m_Config.profile == ContextProfile::eDebug) {
+        for (const auto& e : exts) {
+            std::cout << e.extensionName << std::endl;
+        }
+    }
+
+    // checked up front, so a missing extension is a clear error instead of VK_ERROR_EXTENSION_NOT_PRESENT
+    std::vector<const char*> extensions;
+    for (const char* ext : m_Config.requiredExtensions) {
+        if (!hasName(exts, ext)) throw std::runtime_error(std::string("Missing device extension ") + ext + " on " + m_GpuProperties.properties.deviceName.data());
+        extensions.push_back(ext);
+    }
+    for (const char* ext : m_Config.optionalExtensions) {
+        if (hasName(exts, ext)) extensions.push_back(ext);
+    }
+    m_EnabledExtensions.assign(extensions.begin(), extensions.end());
+
+    if (hasExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+        auto hostProps        = m_Gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceExternalMemoryHostPropertiesEXT>();
+        m_HostImportAlignment = hostProps.get<vk::PhysicalDeviceExternalMemoryHostPropertiesEXT>().minImportedHostPointerAlignment;
+    }
 
     vk::PhysicalDeviceFeatures2 features{};
 
-    vk::PhysicalDeviceBufferDeviceAddressFeatures bdaf{};
-    bdaf.bufferDeviceAddress = true;
-    features.pNext = &bdaf;
+    auto supported = m_Gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>().get<vk::PhysicalDeviceVulkan12Features>();
+
+    vk::PhysicalDeviceVulkan12Features v12f{};
+    v12f.bufferDeviceAddress = true;
+    v12f.timelineSemaphore   = true; // required by 1.2, every submission signals a timeline
+    v12f.hostQueryReset = supported.hostQueryReset; // timestamps are reset from the host between jobs
+    features.pNext = &v12f;
+
+    // required by 1.3, BarrierBatch records vkCmdPipelineBarrier2
+    vk::PhysicalDeviceVulkan13Features v13f{};
+    v13f.synchronization2 = true;
+    v12f.pNext            = &v13f;
+
+    // the extension alone isn't enough, vma only passes allocation priorities on with the feature enabled
+    vk::PhysicalDeviceMemoryPriorityFeaturesEXT priorityf{};
+    if (hasExtension(VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME)) {
+        auto priority            = m_Gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMemoryPriorityFeaturesEXT>();
+        priorityf.memoryPriority = priority.get<vk::PhysicalDeviceMemoryPriorityFeaturesEXT>().memoryPriority;
+        v13f.pNext               = &priorityf;
+    }
+    m_MemoryPriority = priorityf.memoryPriority;
+
+    // async compute and transfer-only families when the device has them. transfer families with a coarse image transfer granularity
+    // can't copy edge tiles, those copies stay on the graphics queue
+    auto families = m_Gpu.getQueueFamilyProperties();
+
+    auto graphics = findQueueFamily(families, vk::QueueFlagBits::eGraphics, {});
+    if (!graphics) throw std::runtime_error(std::string("No graphics queue on ") + m_GpuProperties.properties.deviceName.data());
+
+    uint32_t compute  = findQueueFamily(families, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics).value_or(*graphics);
+    uint32_t transfer = *graphics;
+    if (auto t = findQueueFamily(families, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute); t && families[*t].minImageTransferGranularity == vk::Extent3D(1, 1, 1)) {
+        transfer = *t;
+    }
+    m_QueueFamilies = {*graphics, compute, transfer};
+
+    m_TimestampValidBits = families[*graphics].timestampValidBits;
+    for (size_t q = 0; q < QUEUE_TYPE_COUNT; q++) {
+        uint32_t bits      = families[m_QueueFamilies[q]].timestampValidBits;
+        m_QueueTimestamps[q] = bits > 0;
+        if (bits > 0) m_TimestampValidBits = std::min(m_TimestampValidBits, bits);
+    }
+    m_TimestampsSupported = m_Config.profile != ContextProfile::eRelease && supported.hostQueryReset && m_GpuProperties.properties.limits.timestampComputeAndGraphics && m_QueueTimestamps[0];
 
     std::array<float, 1> qp = {1.0f};
     std::vector<vk::DeviceQueueCreateInfo> dqcis{};
-    dqcis.push_back(vk::DeviceQueueCreateInfo({}, 0, qp)); // we do a bit of assumptions
+    for (size_t q = 0; q < QUEUE_TYPE_COUNT; q++) {
+        uint32_t family = m_QueueFamilies[q];
+        bool     seen   = std::any_of(dqcis.begin(), dqcis.end(), [&](const vk::DeviceQueueCreateInfo& dqci) { return dqci.queueFamilyIndex == family; });
+        if (!seen) dqcis.push_back(vk::DeviceQueueCreateInfo({}, family, qp));
+    }
 
     std::cout << "creating device," << std::endl;
 
@@ -132,18 +337,21 @@ void GraphicsContext::createDevice() {
     VkDevice dev;
     vk::Result res = (vk::Result)vkCreateDevice(m_Gpu, &dci, nullptr, &dev);
 
-    std::cout << "Res: " << vk::to_string(res) << std::endl;
-
-    if (res != vk::Result::eSuccess) sleep(60);
+    if (res != vk::Result::eSuccess) throw std::runtime_error("vkCreateDevice failed: " + vk::to_string(res));
 
     m_Device = dev;
     std::cout << "created device," << std::endl;
-    m_Queue = m_Device.getQueue(0, 0);
+    for (size_t q = 0; q < QUEUE_TYPE_COUNT; q++) {
+        m_Queues[q] = m_Device.getQueue(m_QueueFamilies[q], 0);
+    }
+    std::cout << "queue families: graphics " << m_QueueFamilies[0] << ", compute " << m_QueueFamilies[1] << ", transfer " << m_QueueFamilies[2] << std::endl;
 }
 
 void GraphicsContext::createAllocator() {
     VmaAllocatorCreateInfo ci{};
-    ci.flags = VMA_ALLOCATOR_CREATE_KHR_DEDICATED_ALLOCATION_BIT | VMA_ALLOCATOR_CREATE_KHR_BIND_MEMORY2_BIT | VMA_ALLOCATOR_CREATE_KHR_MAINTENANCE4_BIT | VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT | VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT | VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT;
+    ci.flags = VMA_ALLOCATOR_CREATE_KHR_DEDICATED_ALLOCATION_BIT | VMA_ALLOCATOR_CREATE_KHR_BIND_MEMORY2_BIT | VMA_ALLOCATOR_CREATE_KHR_MAINTENANCE4_BIT | VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    if (hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) ci.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    if (m_MemoryPriority) ci.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT;
     ci.vulkanApiVersion = VK_API_VERSION_1_3;
     ci.physicalDevice = m_Gpu;
     ci.device = m_Device;
@@ -152,26 +360,145 @@ void GraphicsContext::createAllocator() {
     vmaCreateAllocator(&ci, &m_Allocator);
 }
 
-Image GraphicsContext::createImage(const vk::ImageCreateInfo &ici, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage) const {
+MemoryHeadroom GraphicsContext::memoryHeadroom() const {
+    std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+    vmaGetHeapBudgets(m_Allocator, budgets.data());
+
+    const VkPhysicalDeviceMemoryProperties* props;
+    vmaGetMemoryProperties(m_Allocator, &props);
+
+    auto free = [&](uint32_t heap) -> vk::DeviceSize { return budgets[heap].usage < budgets[heap].budget ? budgets[heap].budget - budgets[heap].usage : 0; };
+
+    MemoryHeadroom headroom{};
+    for (uint32_t h = 0; h < props->memoryHeapCount; h++) {
+        if (props->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) headroom.device = std::max(headroom.device, free(h));
+    }
+
+    // readback buffers prefer HOST_CACHED (see createReadbackBuffer), only count plain host visible heaps when there's no cached type
+    VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t t = 0; t < props->memoryTypeCount; t++) {
+        if ((props->memoryTypes[t].propertyFlags & cached) == cached) wanted = cached;
+    }
+
+    for (uint32_t t = 0; t < props->memoryTypeCount; t++) {
+        if ((props->memoryTypes[t].propertyFlags & wanted) == wanted) headroom.host = std::max(headroom.host, free(props->memoryTypes[t].heapIndex));
+    }
+
+    return headroom;
+}
+
+bool GraphicsContext::hasExtension(const char *name) const {
+    return std::find(m_EnabledExtensions.begin(), m_EnabledExtensions.end(), name) != m_EnabledExtensions.end();
+}
+
+void GraphicsContext::createCommandRings() {
+    for (size_t q = 0; q < QUEUE_TYPE_COUNT; q++) {
+        auto& ring = m_Rings[q];
+        ring.pool  = m_Device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, m_QueueFamilies[q]));
+
+        auto cmds = m_Device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(ring.pool, vk::CommandBufferLevel::ePrimary, COMMAND_RING_SIZE));
+        for (uint32_t i = 0; i < COMMAND_RING_SIZE; i++) {
+            ring.slots[i].cmd = cmds[i];
+        }
+
+        vk::SemaphoreTypeCreateInfo type(vk::SemaphoreType::eTimeline, 0);
+        vk::SemaphoreCreateInfo     sci{};
+        sci.pNext      = &type;
+        m_Timelines[q] = m_Device.createSemaphore(sci);
+    }
+}
+
+std::string GraphicsContext::pipelineCacheName() const {
+    const auto& props = m_GpuProperties.properties;
+
+    std::stringstream name;
+    name << "pipeline/" << std::hex << props.vendorID << '-' << props.deviceID << '-';
+    for (uint8_t b : props.pipelineCacheUUID) {
+        name << std::setw(2) << std::setfill('0') << (int)b;
+    }
+    name << ".bin";
+    return name.str();
+}
+
+bool GraphicsContext::isCompatiblePipelineCache(const std::vector<uint8_t> &data) const {
+    const auto& props = m_GpuProperties.properties;
+
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) return false;
+    memcpy(&header, data.data(), sizeof(header));
+
+    // the driver would reject a mismatched blob anyway, but some drivers crash instead of rejecting so check it ourselves
+    return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == props.vendorID && header.deviceID == props.deviceID &&
+           memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+void GraphicsContext::createPipelineCache() {
+    vk::PipelineCacheCreateInfo pcci{};
+
+    auto data = readCacheFile(pipelineCacheName());
+    if (data && isCompatiblePipelineCache(*data)) {
+        pcci.initialDataSize = data->size();
+        pcci.pInitialData    = data->data();
+    }
+
+    m_PipelineCache = m_Device.createPipelineCache(pcci);
+    std::cout << "created pipeline cache (" << pcci.initialDataSize << " bytes loaded)" << std::endl;
+}
+
+void GraphicsContext::savePipelineCache() const {
+    // contexts for identical gpus share the file, merge with whatever the others saved since we loaded it
+    static std::mutex saveMutex;
+    std::lock_guard   lock(saveMutex);
+
+    std::string name = pipelineCacheName();
+    if (auto data = readCacheFile(name); data && isCompatiblePipelineCache(*data)) {
+        vk::PipelineCache onDisk = m_Device.createPipelineCache(vk::PipelineCacheCreateInfo({}, data->size(), data->data()));
+        m_Device.mergePipelineCaches(m_PipelineCache, onDisk);
+        m_Device.destroy(onDisk);
+    }
+
+    auto merged = m_Device.getPipelineCacheData(m_PipelineCache);
+    writeCacheFile(name, merged.data(), merged.size());
+}
+
+void GraphicsContext::createTimestampPool() {
+    if (!m_TimestampsSupported) {
+        std::cout << "timestamps not supported, gpu timings disabled" << std::endl;
+        return;
+    }
+
+    m_TimestampCapacity = MIN_TIMESTAMP_QUERIES;
+    m_TimestampPool     = m_Device.createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, m_TimestampCapacity));
+    resetTimestamps();
+}
+
+Image GraphicsContext::createImage(const vk::ImageCreateInfo &ici, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage, AllocationPriority priority) const {
     VmaAllocationCreateInfo aci{};
     aci.flags = aci_flags;
     aci.requiredFlags = (VkMemoryPropertyFlags)requiredFlags;
     aci.usage = usage;
+    applyPriority(aci, priority);
 
     VkImageCreateInfo ici_ = ici;
 
     Image img;
     VkImage img_;
     vmaCreateImage(m_Allocator, &ici_, &aci, &img_, &img.allocation, &img.allocationInfo);
-    img.image = img_;
+    img.image  = img_;
+    img.extent = ici.extent;
+    img.format = ici.format;
+    img.state.layout = ici.initialLayout;
     return img;
 }
 
-Buffer GraphicsContext::createBuffer(const vk::BufferCreateInfo &bci, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage) const {
+Buffer GraphicsContext::createBuffer(const vk::BufferCreateInfo &bci, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage, vk::MemoryPropertyFlags preferredFlags, AllocationPriority priority) const {
     VmaAllocationCreateInfo aci{};
     aci.flags = aci_flags;
     aci.requiredFlags = (VkMemoryPropertyFlags)requiredFlags;
+    aci.preferredFlags = (VkMemoryPropertyFlags)preferredFlags;
     aci.usage = usage;
+    applyPriority(aci, priority);
 
     VkBufferCreateInfo bci_ = bci;
 
@@ -179,10 +506,11 @@ Buffer GraphicsContext::createBuffer(const vk::BufferCreateInfo &bci, VmaAllocat
     VkBuffer buf_;
     vmaCreateBuffer(m_Allocator, &bci_, &aci, &buf_, &buf.allocation, &buf.allocationInfo);
     buf.buffer = buf_;
+    buf.size   = bci.size;
     return buf;
 }
 
-Image GraphicsContext::createImageHost(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, bool allowMapping) const {
+Image GraphicsContext::createImageHost(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, bool allowMapping, AllocationPriority priority) const {
     vk::ImageCreateInfo ici{};
     ici.format = format;
     ici.extent = vk::Extent3D(width, height, 1);
@@ -196,10 +524,10 @@ Image GraphicsContext::createImageHost(uint32_t width, uint32_t height, vk::Form
     VmaAllocationCreateFlags acif = 0;
     if (allowMapping) acif |= VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
 
-    return createImage(ici, acif, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
+    return createImage(ici, acif, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST, priority);
 }
 
-Image GraphicsContext::createImageDevice(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling) const {
+Image GraphicsContext::createImageDevice(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, AllocationPriority priority) const {
     vk::ImageCreateInfo ici{};
     ici.format = format;
     ici.extent = vk::Extent3D(width, height, 1);
@@ -211,58 +539,403 @@ Image GraphicsContext::createImageDevice(uint32_t width, uint32_t height, vk::Fo
     ici.tiling = tiling;
     ici.sharingMode = vk::SharingMode::eExclusive;
 
-    return createImage(ici, 0, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    return createImage(ici, 0, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, priority);
+}
+
+VmaAllocation GraphicsContext::allocateDeviceMemory(const vk::MemoryRequirements &requirements, AllocationPriority priority) const {
+    VmaAllocationCreateInfo aci{};
+    aci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    applyPriority(aci, priority);
+
+    VkMemoryRequirements reqs = requirements;
+    VmaAllocation        allocation;
+    vk::Result           res = (vk::Result)vmaAllocateMemory(m_Allocator, &reqs, &aci, &allocation, nullptr);
+    if (res != vk::Result::eSuccess) throw std::runtime_error("vmaAllocateMemory failed: " + vk::to_string(res));
+    return allocation;
+}
+
+Buffer GraphicsContext::createBufferHost(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority) const {
+    vk::BufferCreateInfo bci{};
+    bci.usage = usage;
+    bci.size = size;
+    bci.sharingMode = vk::SharingMode::eExclusive;
+
+    return createBuffer(bci, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST, {}, priority);
 }
 
-Buffer GraphicsContext::createBufferHost(size_t size, vk::BufferUsageFlags usage) const {
+Buffer GraphicsContext::createBufferDevice(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority) const {
     vk::BufferCreateInfo bci{};
     bci.usage = usage;
     bci.size = size;
     bci.sharingMode = vk::SharingMode::eExclusive;
 
-    return createBuffer(bci, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
+    return createBuffer(bci, 0, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, {}, priority);
 }
 
-Buffer GraphicsContext::createBufferDevice(size_t size, vk::BufferUsageFlags usage) const {
+MappedBuffer GraphicsContext::createMappedBuffer(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority) const {
     vk::BufferCreateInfo bci{};
     bci.usage = usage;
     bci.size = size;
     bci.sharingMode = vk::SharingMode::eExclusive;
 
-    return createBuffer(bci, 0, vk::MemoryPropertyFlagBits::eDeviceLocal, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    // coherent isn't required, non-coherent memory just needs the explicit invalidate/flush
+    MappedBuffer buf{createBuffer(bci, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST, {}, priority)};
+    buf.data = buf.allocationInfo.pMappedData;
+
+    VkMemoryPropertyFlags props;
+    vmaGetAllocationMemoryProperties(m_Allocator, buf.allocation, &props);
+    buf.coherent = (props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    return buf;
+}
+
+MappedBuffer GraphicsContext::createReadbackBuffer(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority) const {
+    vk::BufferCreateInfo bci{};
+    bci.usage = usage;
+    bci.size = size;
+    bci.sharingMode = vk::SharingMode::eExclusive;
+
+    MappedBuffer buf{createBuffer(bci, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, vk::MemoryPropertyFlagBits::eHostVisible, VMA_MEMORY_USAGE_AUTO_PREFER_HOST, vk::MemoryPropertyFlagBits::eHostCached, priority)};
+    buf.data = buf.allocationInfo.pMappedData;
+
+    VkMemoryPropertyFlags props;
+    vmaGetAllocationMemoryProperties(m_Allocator, buf.allocation, &props);
+    buf.coherent = (props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    return buf;
+}
+
+void GraphicsContext::invalidate(const MappedBuffer &buffer, vk::DeviceSize offset, vk::DeviceSize size) const {
+    if (!buffer.coherent) vmaInvalidateAllocation(m_Allocator, buffer.allocation, offset, size);
+}
+
+void GraphicsContext::flush(const MappedBuffer &buffer, vk::DeviceSize offset, vk::DeviceSize size) const {
+    if (!buffer.coherent) vmaFlushAllocation(m_Allocator, buffer.allocation, offset, size);
 }
 
 vk::CommandBuffer GraphicsContext::allocateCommandBuffer() const {
     return m_Device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(m_Pool, vk::CommandBufferLevel::ePrimary, 1))[0];
 }
 
+vk::CommandBuffer GraphicsContext::allocateCommandBuffer(QueueType queue) const {
+    return m_Device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(m_Rings[(size_t)queue].pool, vk::CommandBufferLevel::ePrimary, 1))[0];
+}
+
+ThreadCommandPool &GraphicsContext::threadPoolState() {
+    std::lock_guard lock(m_ThreadPoolsMutex);
+
+    auto& state = m_ThreadPools[std::this_thread::get_id()];
+    if (!state) {
+        state       = std::make_unique<ThreadCommandPool>();
+        state->pool = m_Device.createCommandPool(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, getQueueFamily(QueueType::eGraphics)));
+    }
+    return *state;
+}
+
+vk::CommandPool GraphicsContext::threadCommandPool() {
+    return threadPoolState().pool;
+}
+
+SecondaryBatch GraphicsContext::recordSecondaries(uint32_t count, vk::RenderPass renderPass, vk::Framebuffer framebuffer,
+                                                  const std::function<void(const vk::CommandBuffer &, uint32_t)> &f, ThreadPool *pool) {
+    recycleSecondaries();
+    if (!pool) pool = &ThreadPool::shared();
+
+    SecondaryBatch batch;
+    batch.commands.resize(count);
+    batch.pools.resize(count);
+
+    vk::CommandBufferInheritanceInfo inheritance(renderPass, 0, framebuffer);
+    vk::CommandBufferBeginInfo       begin(vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &inheritance);
+
+    // one contiguous range per thread, so a thread allocates from its pool once per batch
+    uint32_t                       tasks = std::min<uint32_t>(count, (uint32_t)pool->size());
+    std::vector<std::future<void>> recorded;
+    recorded.reserve(tasks);
+
+    for (uint32_t t = 0; t < tasks; t++) {
+        uint32_t first = (uint32_t)((uint64_t)count * t / tasks);
+        uint32_t last  = (uint32_t)((uint64_t)count * (t + 1) / tasks);
+
+        recorded.push_back(pool->submit([&, first, last]() {
+            ThreadCommandPool& state = threadPoolState();
+            {
+                std::lock_guard lock(state.retiredMutex);
+                state.free.insert(state.free.end(), state.retired.begin(), state.retired.end());
+                state.retired.clear();
+            }
+
+            size_t needed = last - first;
+            if (state.free.size() < needed) {
+                auto more = m_Device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(state.pool, vk::CommandBufferLevel::eSecondary, (uint32_t)(needed - state.free.size())));
+                state.free.insert(state.free.end(), more.begin(), more.end());
+            }
+
+            for (uint32_t i = first; i < last; i++) {
+                vk::CommandBuffer cmd = state.free.back();
+                state.free.pop_back();
+                batch.commands[i] = cmd;
+                batch.pools[i]    = &state;
+
+                // the pool is created with eResetCommandBuffer, so begin() implicitly resets the buffer
+                cmd.begin(begin);
+                try {
+                    f(cmd, i);
+                } catch (...) {
+                    cmd.reset(); // out of the recording state, so it can be begun again
+                    throw;
+                }
+                cmd.end();
+            }
+        }));
+    }
+
+    // the tasks reference the batch, every one has to be done before an error leaves this function
+    std::exception_ptr error;
+    for (auto& r : recorded) {
+        try {
+            r.get();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) {
+        releaseSecondaries(batch);
+        std::rethrow_exception(error);
+    }
+
+    return batch;
+}
+
+void GraphicsContext::releaseSecondaries(SecondaryBatch &batch, const CommandTicket &lastUse) {
+    if (!batch.commands.empty()) m_RetiredBatches.push_back({std::move(batch), lastUse});
+    batch = {};
+
+    recycleSecondaries();
+}
+
+void GraphicsContext::recycleSecondaries() {
+    std::erase_if(m_RetiredBatches, [&](const RetiredBatch& retired) {
+        if (!commandsComplete(retired.lastUse)) return false;
+
+        for (size_t i = 0; i < retired.batch.commands.size(); i++) {
+            if (!retired.batch.commands[i]) continue; // never recorded, the batch failed part way
+
+            ThreadCommandPool* state = retired.batch.pools[i];
+            std::lock_guard    lock(state->retiredMutex);
+            state->retired.push_back(retired.batch.commands[i]);
+        }
+        return true;
+    });
+}
+
 void GraphicsContext::runCommands(const std::function<void(const vk::CommandBuffer &)> &f) {
-    auto cmd = allocateCommandBuffer();
-    auto fence = createFence();
+    waitForCommands(recordAndSubmit(f));
+}
+
+CommandTicket GraphicsContext::runCommandsAsync(const std::function<void(const vk::CommandBuffer &)> &f) {
+    return recordAndSubmit(f);
+}
 
-    cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-    f(cmd);
-    cmd.end();
+CommandTicket GraphicsContext::runCommandsAsync(QueueType queue, const std::function<void(const vk::CommandBuffer &)> &f, std::span<const SubmitWait> after) {
+    return recordAndSubmit(queue, f, after);
+}
 
-    submitCommands(cmd, fence);
-    waitForFence(fence);
+CommandTicket GraphicsContext::runWithReadback(const std::function<void(const vk::CommandBuffer &)> &f, Image &image, Buffer &buffer, const vk::BufferImageCopy &region, std::string readbackLabel) {
+    if (!hasTransferQueue()) {
+        return recordAndSubmit([&](const vk::CommandBuffer& cmd) {
+            f(cmd);
+            auto t = readbackLabel.empty() ? GpuTimestampScope{} : timestampScope(cmd, readbackLabel);
+            recordReadback(cmd, image, buffer, region);
+        });
+    }
 
-    destroy(fence);
-    m_Device.freeCommandBuffers(m_Pool, cmd);
+    CommandTicket rendered = recordAndSubmit([&](const vk::CommandBuffer& cmd) {
+        f(cmd);
+        recordReadbackRelease(cmd, image);
+    });
+    return submitReadback(rendered, image, buffer, region, std::move(readbackLabel));
 }
 
-vk::Fence GraphicsContext::createFence() const {
-    return m_Device.createFence({});
+// the image changes families for the copy: the graphics side makes its writes available and gives it up, the transfer side acquires it.
+// it goes back to the graphics family implicitly, the next render pass starts from eUndefined and doesn't care about the contents
+void GraphicsContext::recordReadbackRelease(const vk::CommandBuffer &cmd, Image &image) const {
+    if (!hasTransferQueue()) return;
+
+    // the copy reads eTransferSrcOptimal. render passes end in it already, anything else is transitioned while the image is still the
+    // graphics queue's (in a barrier of its own, barriers in one batch aren't ordered)
+    BarrierBatch barriers;
+    if (image.state.layout != vk::ImageLayout::eTransferSrcOptimal) {
+        barriers.use(image, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal);
+        barriers.flush(cmd);
+    }
+    barriers.release(image, getQueueFamily(QueueType::eGraphics), getQueueFamily(QueueType::eTransfer));
+    barriers.flush(cmd);
 }
 
-void GraphicsContext::waitForFence(vk::Fence fence) const {
-    auto _ = m_Device.waitForFences(fence, true, UINT64_MAX);
+CommandTicket GraphicsContext::submitReadback(const CommandTicket &rendered, Image &image, Buffer &buffer, const vk::BufferImageCopy &region, std::string readbackLabel) {
+    SubmitWait afterRender{rendered, vk::PipelineStageFlagBits::eTransfer};
+
+    if (!hasTransferQueue()) {
+        return recordAndSubmit(QueueType::eGraphics, [&](const vk::CommandBuffer& cmd) {
+            auto t = readbackLabel.empty() ? GpuTimestampScope{} : timestampScope(cmd, readbackLabel);
+            recordReadback(cmd, image, buffer, region);
+        }, {&afterRender, 1});
+    }
+
+    return recordAndSubmit(QueueType::eTransfer, [&](const vk::CommandBuffer& cmd) {
+        BarrierBatch barriers;
+        barriers.acquire(image, getQueueFamily(QueueType::eGraphics), getQueueFamily(QueueType::eTransfer), vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead);
+        barriers.flush(cmd);
+
+        auto t = readbackLabel.empty() ? GpuTimestampScope{} : timestampScope(cmd, readbackLabel, QueueType::eTransfer);
+        recordReadback(cmd, image, buffer, region);
+    }, {&afterRender, 1});
 }
 
-void GraphicsContext::submitCommands(vk::CommandBuffer cmd, vk::Fence fence) const {
+CommandTicket GraphicsContext::submitWorkload(RecordedWorkload &workload, std::span<const SubmitWait> after) {
+    waitForCommands(workload.lastSubmit);
+    workload.lastSubmit = submitTimeline(workload.queue, workload.cmd, after);
+    return workload.lastSubmit;
+}
+
+uint32_t GraphicsContext::acquireSlot(QueueType queue) {
+    auto&    ring  = m_Rings[(size_t)queue];
+    uint32_t index = ring.head;
+    ring.head      = (ring.head + 1) % COMMAND_RING_SIZE;
+
+    const auto& slot = ring.slots[index];
+    waitForCommands({m_Timelines[(size_t)queue], slot.value, queue});
+    return index;
+}
+
+CommandTicket GraphicsContext::submitCommands(vk::CommandBuffer cmd, QueueType queue, std::span<const SubmitWait> after) {
+    return submitTimeline(queue, cmd, after);
+}
+
+CommandTicket GraphicsContext::submitTimeline(QueueType queue, vk::CommandBuffer cmd, std::span<const SubmitWait> after) {
+    std::vector<vk::Semaphore>          waitSemaphores;
+    std::vector<uint64_t>               waitValues;
+    std::vector<vk::PipelineStageFlags> waitStages;
+    for (const auto& wait : after) {
+        if (!wait.ticket.semaphore) continue; // default ticket, nothing to wait for
+        waitSemaphores.push_back(wait.ticket.semaphore);
+        waitValues.push_back(wait.ticket.value);
+        waitStages.push_back(wait.stage);
+    }
+
+    vk::Semaphore timeline = m_Timelines[(size_t)queue];
+    uint64_t      value    = m_TimelineValues[(size_t)queue] + 1;
+
+    vk::TimelineSemaphoreSubmitInfo tssi{};
+    tssi.setWaitSemaphoreValues(waitValues);
+    tssi.setSignalSemaphoreValues(value);
+
     vk::SubmitInfo si{};
+    si.pNext = &tssi;
     si.setCommandBuffers(cmd);
-    m_Queue.submit(si, fence);
+    si.setWaitSemaphores(waitSemaphores);
+    si.setWaitDstStageMask(waitStages);
+    si.setSignalSemaphores(timeline);
+
+    getQueue(queue).submit(si);
+    // only once the submit went through, a value nothing signals would hang every wait on it
+    m_TimelineValues[(size_t)queue] = value;
+
+    return {timeline, value, queue};
+}
+
+void GraphicsContext::waitForCommands(const CommandTicket &ticket) const {
+    auto _ = waitForCommands(ticket, std::chrono::nanoseconds::max());
+}
+
+bool GraphicsContext::waitForCommands(const CommandTicket &ticket, std::chrono::nanoseconds timeout) const {
+    if (!ticket.semaphore || ticket.value == 0) return true;
+
+    vk::SemaphoreWaitInfo wi{};
+    wi.setSemaphores(ticket.semaphore);
+    wi.setValues(ticket.value);
+    return m_Device.waitSemaphores(wi, timeout == std::chrono::nanoseconds::max() ? UINT64_MAX : (uint64_t)std::max<int64_t>(timeout.count(), 0)) == vk::Result::eSuccess;
+}
+
+bool GraphicsContext::commandsComplete(const CommandTicket &ticket) const {
+    if (!ticket.semaphore || ticket.value == 0) return true;
+
+    return m_Device.getSemaphoreCounterValue(ticket.semaphore) >= ticket.value;
+}
+
+void GraphicsContext::recordReadback(const vk::CommandBuffer &cmd, Image &image, Buffer &buffer) const {
+    recordReadback(cmd, image, buffer, vk::BufferImageCopy(0, 0, 0, STANDARD_IMAGE_SUBRESOURCE_LAYERS, {0, 0, 0}, image.extent));
+}
+
+void GraphicsContext::recordReadback(const vk::CommandBuffer &cmd, Image &image, Buffer &buffer, const vk::BufferImageCopy &region) const {
+    BarrierBatch barriers;
+    barriers.use(image, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal);
+    barriers.use(buffer, vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite);
+    barriers.flush(cmd);
+
+    cmd.copyImageToBuffer(image.image, vk::ImageLayout::eTransferSrcOptimal, buffer.buffer, region);
+
+    barriers.use(buffer, vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead);
+    barriers.flush(cmd);
+}
+
+GpuTimestampScope GraphicsContext::timestampScope(const vk::CommandBuffer &cmd, std::string label, QueueType queue) {
+    if (!m_TimestampPool || !m_QueueTimestamps[(size_t)queue]) return {};
+    if (m_NextQuery + 2 > m_TimestampCapacity) {
+        m_DroppedScopes++;
+        return {};
+    }
+
+    uint32_t query = m_NextQuery;
+    m_NextQuery += 2;
+    m_TimestampLabels.push_back(std::move(label));
+
+    cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_TimestampPool, query);
+    return {cmd, m_TimestampPool, query + 1};
+}
+
+void GraphicsContext::resetTimestamps() {
+    if (!m_TimestampPool) return;
+
+    m_Device.resetQueryPool(m_TimestampPool, 0, m_TimestampCapacity);
+    m_NextQuery     = 0;
+    m_DroppedScopes = 0;
+    m_TimestampLabels.clear();
+}
+
+void GraphicsContext::reserveTimestamps(uint32_t scopes) {
+    if (timestampsFit(scopes)) return;
+
+    m_Device.destroy(m_TimestampPool);
+    m_TimestampCapacity = std::bit_ceil(scopes * 2);
+    m_TimestampPool     = m_Device.createQueryPool(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, m_TimestampCapacity));
+    resetTimestamps();
+}
+
+std::vector<GpuTiming> GraphicsContext::collectTimestamps() const {
+    std::vector<GpuTiming> timings;
+    if (m_DroppedScopes > 0) {
+        std::stringstream ss;
+        ss << m_GpuProperties.properties.deviceName.data() << ": " << m_DroppedScopes << " gpu timing scopes didn't fit the " << m_TimestampCapacity
+           << " timestamp queries and weren't timed\n";
+        std::cerr << ss.str() << std::flush;
+    }
+    if (!m_TimestampPool || m_NextQuery == 0) return timings;
+
+    std::vector<uint64_t> ticks(m_NextQuery);
+    auto _ = m_Device.getQueryPoolResults(m_TimestampPool, 0, m_NextQuery, ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+
+    uint64_t mask   = m_TimestampValidBits >= 64 ? UINT64_MAX : (1ull << m_TimestampValidBits) - 1;
+    double   period = m_GpuProperties.properties.limits.timestampPeriod; // nanoseconds per tick
+
+    for (size_t i = 0; i < m_TimestampLabels.size(); i++) {
+        uint64_t delta = ((ticks[i * 2 + 1] & mask) - (ticks[i * 2] & mask)) & mask;
+        timings.push_back({m_TimestampLabels[i], (double)delta * period / 1e6});
+    }
+    return timings;
+}
+
+void GraphicsContext::readbackImage(Image &image, Buffer &buffer) {
+    waitForCommands(recordAndSubmit([&](const vk::CommandBuffer &cmd) { recordReadback(cmd, image, buffer); }));
 }
 
 void GraphicsContext::destroy(const Image &image) const {
@@ -275,6 +948,10 @@ void GraphicsContext::destroy(const Buffer &buffer) const {
     freeAllocation(buffer.allocation);
 }
 
+void GraphicsContext::destroy(const RecordedWorkload &workload) const {
+    m_Device.freeCommandBuffers(m_Rings[(size_t)workload.queue].pool, workload.cmd);
+}
+
 void GraphicsContext::freeAllocation(VmaAllocation alloc) const {
     vmaFreeMemory(m_Allocator, alloc);
 }
@@ -314,41 +991,160 @@ void GraphicsContext::unmapImage(const Image &image) const {
 }
 
 void GraphicsContext::saveImage(const std::string &path, const Image &image, int width, int height, int channels, int bpp) const {
-    void* map = mapImage(image);
-    void* data = malloc(width * height * bpp);
-    memcpy(data, map, width * height * bpp);
+    // linear images can have padded rows, the encoder walks them with the real pitch straight out of the mapping
+    vk::SubresourceLayout layout = m_Device.getImageSubresourceLayout(image.image, STANDARD_IMAGE_SUBRESOURCE);
+
+    auto* map = (const uint8_t*)mapImage(image);
+    try {
+        saveImage(path, map + layout.offset, width, height, channels, bpp, layout.rowPitch);
+    } catch (...) {
+        unmapImage(image);
+        throw;
+    }
     unmapImage(image);
-    saveImage(path, data, width, height, channels, bpp);
-    free(data);
 }
 
 void GraphicsContext::saveBufferImage(const std::string &path, const Buffer &bufferImage, int width, int height, int channels, int bpp) const {
     void* map = mapBuffer(bufferImage);
-    void* data = malloc(width * height * bpp);
-    memcpy(data, map, width * height * bpp);
+    try {
+        saveImage(path, map, width, height, channels, bpp);
+    } catch (...) {
+        unmapBuffer(bufferImage);
+        throw;
+    }
     unmapBuffer(bufferImage);
-    saveImage(path, data, width, height, channels, bpp);
-    free(data);
 }
 
-void GraphicsContext::saveImage(const std::string &path, const void *data, int width, int height, int channels, int bpp) {
-    stbi_write_png(path.c_str(), width, height, channels, data, 0);
+void GraphicsContext::saveBufferImage(const std::string &path, const MappedBuffer &bufferImage, int width, int height, int channels, int bpp, std::optional<OutputFormat> format) const {
+    invalidate(bufferImage);
+    saveImage(path, bufferImage.data, width, height, channels, bpp, 0, format);
 }
 
-std::vector<uint32_t> GraphicsContext::compileShader(const std::string &path) const {
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
-    std::string source = readFile(path);
-    options.SetOptimizationLevel(shaderc_optimization_level_performance);
+void GraphicsContext::saveImage(const std::string &path, const void *data, int width, int height, int channels, int bpp, size_t stride, std::optional<OutputFormat> format) {
+    writeImage(format.value_or(formatFromPath(path)), path, data, width, height, channels, stride != 0 ? stride : (size_t)width * bpp);
+}
 
-    auto res = compiler.CompileGlslToSpv(source, shaderc_glsl_infer_from_source, path.c_str(), options);
-    auto status = res.GetCompilationStatus();
-    if (status != shaderc_compilation_status_success) {
-        std::cerr << "Error compiling shader " << path << ": " << res.GetErrorMessage() << std::endl;
-        throw std::runtime_error("Error compiling shader");
+MappedBuffer GraphicsContext::acquireStagingBuffer(size_t size) {
+    return m_Resources->acquireBuffer(size, vk::BufferUsageFlagBits::eTransferDst, MemoryClass::eReadback);
+}
+
+void GraphicsContext::releaseStagingBuffer(const MappedBuffer &buffer) {
+    m_Resources->releaseBuffer(buffer, vk::BufferUsageFlagBits::eTransferDst, MemoryClass::eReadback);
+}
+
+std::future<void> GraphicsContext::saveBufferImageAsync(const std::string &path, const MappedBuffer &bufferImage, int width, int height, int channels, int bpp, std::optional<OutputFormat> format) {
+    return m_Writers->submit([this, path, bufferImage, width, height, channels, bpp, format]() {
+        // release even if encoding throws, the exception still reaches the caller through the future
+        struct Release {
+            GraphicsContext*    gc;
+            const MappedBuffer& buffer;
+
+            ~Release() { gc->releaseStagingBuffer(buffer); }
+        } release{this, bufferImage};
+
+        saveBufferImage(path, bufferImage, width, height, channels, bpp, format);
+    });
+}
+
+bool GraphicsContext::supportsMappedFiles() const noexcept {
+#ifdef BS_HAS_MMAP
+    return m_HostImportAlignment != 0;
+#else
+    return false;
+#endif
+}
+
+std::optional<MappedFile> GraphicsContext::createMappedFile(const std::string &path, OutputFormat format, uint32_t width, uint32_t height, uint32_t channels) const {
+#ifdef BS_HAS_MMAP
+    if (!supportsMappedFiles() || !hasRawLayout(format)) return std::nullopt;
+
+    size_t      alignment = m_HostImportAlignment;
+    std::string header    = rawLayoutHeader(format, width, height, channels, format == OutputFormat::eRaw ? 1 : alignment);
+
+    MappedFile file{};
+    file.dataOffset = header.size();
+    file.dataSize   = (size_t)width * height * channels;
+    file.size       = (file.dataSize + alignment - 1) / alignment * alignment; // imports come in whole alignment units
+    file.mapSize    = file.dataOffset + file.size;
+
+    // anything unexpected just means the staging path, so undo what's there and let the caller write the file normally
+    auto fail = [&]() -> std::optional<MappedFile> {
+        closeMappedFile(file);
+        ::unlink(path.c_str());
+        return std::nullopt;
+    };
+
+    file.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file.fd < 0) return std::nullopt;
+    if (ftruncate(file.fd, (off_t)file.mapSize) != 0) return fail();
+
+    void* map = mmap(nullptr, file.mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+    if (map == MAP_FAILED) return fail();
+    file.map = (uint8_t*)map;
+    memcpy(file.map, header.data(), header.size());
+
+    uint8_t* data = file.map + file.dataOffset;
+    if ((uintptr_t)data % alignment != 0) return fail(); // alignment above the page size
+
+    auto getHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)m_Device.getProcAddr("vkGetMemoryHostPointerPropertiesEXT");
+
+    VkMemoryHostPointerPropertiesEXT hostProps{VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT};
+    if (!getHostPointerProperties || getHostPointerProperties(m_Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, data, &hostProps) != VK_SUCCESS) return fail();
+
+    try {
+        vk::ExternalMemoryBufferCreateInfo ebci(vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT);
+        vk::BufferCreateInfo               bci({}, file.size, vk::BufferUsageFlagBits::eTransferDst);
+        bci.pNext   = &ebci;
+        file.buffer = m_Device.createBuffer(bci);
+
+        auto reqs     = m_Device.getBufferMemoryRequirements(file.buffer);
+        auto memProps = m_Gpu.getMemoryProperties();
+
+        // coherent only: the cpu side reads the file through its own mapping, there's nothing to invalidate through
+        uint32_t typeIndex = UINT32_MAX;
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+            if ((hostProps.memoryTypeBits & reqs.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+                typeIndex = i;
+                break;
+            }
+        }
+        if (typeIndex == UINT32_MAX || reqs.size > file.size) return fail();
+
+        vk::ImportMemoryHostPointerInfoEXT import(vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT, data);
+        file.memory = m_Device.allocateMemory(vk::MemoryAllocateInfo(file.size, typeIndex, &import));
+        m_Device.bindBufferMemory(file.buffer, file.memory, 0);
+    } catch (const vk::SystemError& e) {
+        std::cerr << "Failed to import " << path << ", using a staging buffer: " << e.what() << std::endl;
+        return fail();
+    }
+
+    return file;
+#else
+    return std::nullopt;
+#endif
+}
+
+void GraphicsContext::closeMappedFile(MappedFile &file) const {
+    if (file.buffer) m_Device.destroy(file.buffer);
+    if (file.memory) m_Device.free(file.memory);
+
+    bool trimmed = true;
+#ifdef BS_HAS_MMAP
+    if (file.map) munmap(file.map, file.mapSize);
+
+    if (file.fd >= 0) {
+        // drop the padding past the pixels that only existed to make the import size a multiple of the alignment
+        trimmed = ftruncate(file.fd, (off_t)(file.dataOffset + file.dataSize)) == 0;
+        ::close(file.fd);
     }
+#endif
 
-    return std::vector(res.cbegin(), res.cend()); // NOLINT(*-return-braced-init-list)
+    file = MappedFile{};
+    if (!trimmed) throw std::runtime_error("failed to trim mapped output file");
+}
+
+std::vector<uint32_t> GraphicsContext::compileShader(const std::string &path) const {
+    return compileShader(path, "main"); // shaderc's default entry point
 }
 
 vk::ShaderModule GraphicsContext::buildShaderModule(const std::string &path) const {
@@ -357,10 +1153,29 @@ vk::ShaderModule GraphicsContext::buildShaderModule(const std::string &path) con
 }
 
 std::vector<uint32_t> GraphicsContext::compileShader(const std::string &path, const std::string &entry_point) const {
+    constexpr auto OPTIMIZATION_LEVEL = shaderc_optimization_level_performance;
+
+    std::string source = readFile(path);
+
+    // the key covers everything that changes the output, the compiler itself included (see SHADERC_BUILD_VERSION). nothing in
+    // it needs the compiler, a warm start never runs it
+    uint64_t key = fnv1a(source);
+    key          = fnv1a(entry_point, key);
+    key          = fnv1a(&OPTIMIZATION_LEVEL, sizeof(OPTIMIZATION_LEVEL), key);
+    key          = fnv1a(SHADERC_BUILD_VERSION, key);
+
+    std::stringstream name;
+    name << "spirv/" << std::hex << key << '-' << std::dec << source.size() << ".spv";
+
+    if (auto cached = readCacheFile(name.str()); cached && cached->size() % 4 == 0) {
+        std::vector<uint32_t> spirv(cached->size() / 4);
+        memcpy(spirv.data(), cached->data(), cached->size());
+        if (spirv[0] == 0x07230203) return spirv; // spir-v magic, anything else is a corrupt entry and gets recompiled
+    }
+
     shaderc::Compiler compiler;
     shaderc::CompileOptions options;
-    std::string source = readFile(path);
-    options.SetOptimizationLevel(shaderc_optimization_level_performance);
+    options.SetOptimizationLevel(OPTIMIZATION_LEVEL);
 
     auto res = compiler.CompileGlslToSpv(source, shaderc_glsl_infer_from_source, path.c_str(), entry_point.c_str(), options);
     if (res.GetCompilationStatus() != shaderc_compilation_status_success) {
@@ -368,7 +1183,9 @@ std::vector<uint32_t> GraphicsContext::compileShader(const std::string &path, co
         throw std::runtime_error("Error compiling shader");
     }
 
-    return std::vector(res.cbegin(), res.cend());
+    std::vector<uint32_t> spirv(res.cbegin(), res.cend());
+    writeCacheFile(name.str(), spirv.data(), spirv.size() * sizeof(uint32_t));
+    return spirv;
 }
 
 vk::ShaderModule GraphicsContext::buildShaderModule(const std::string &path, const std::string &entry_point) const {
@@ -383,3 +1200,11 @@ vk::ImageView GraphicsContext::createImageView(const Image &image, vk::Format fo
 vk::Framebuffer GraphicsContext::createFramebuffer(vk::RenderPass rp, vk::ImageView iv, vk::Extent2D extent) const {
     return m_Device.createFramebuffer(vk::FramebufferCreateInfo({}, rp, iv, extent.width, extent.height, 1));
 }
+
+GpuTimestampScope::GpuTimestampScope(GpuTimestampScope &&other) noexcept : m_Cmd(other.m_Cmd), m_Pool(other.m_Pool), m_Query(other.m_Query) {
+    other.m_Pool = nullptr;
+}
+
+GpuTimestampScope::~GpuTimestampScope() {
+    if (m_Pool) m_Cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_Pool, m_Query);
+}
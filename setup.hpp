@@ -1,6 +1,7 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include "vk_mem_alloc.h"
+#include "image_writer.hpp"
 
 #include <shaderc/shaderc.hpp>
 
@@ -8,6 +9,18 @@
 #include <functional>
 #include <array>
 #include <string>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+class ThreadPool;
+class ResourceCache;
+struct ThreadCommandPool;
 
 #if __has_include("unistd.h")
 #include <unistd.h>
@@ -30,19 +43,170 @@ inline void sleep(int seconds) {
 
 #endif
 
-vk::Instance createInstance();
+// release: no validation, no enumeration dumps, no gpu timestamps. profiling: release plus timestamps.
+// debug: profiling plus validation, a debug utils messenger and dumps of every extension and layer
+enum class ContextProfile {
+    eRelease,
+    eProfiling,
+    eDebug,
+};
+
+// $BS_PROFILE = release | profiling | debug, release when unset
+ContextProfile profileFromEnvironment();
+
+struct InstanceConfig {
+    ContextProfile profile = ContextProfile::eRelease;
+    // all required, createInstance throws if one is missing. debug utils and validation are added (if available) in debug
+    std::vector<const char*> extensions = {"VK_KHR_device_group_creation", "VK_KHR_get_physical_device_properties2"};
+    std::vector<const char*> layers;
+};
+
+struct DeviceConfig {
+    ContextProfile profile = ContextProfile::eRelease;
+    std::vector<const char*> requiredExtensions;
+    // enabled when present, see GraphicsContext::hasExtension
+    std::vector<const char*> optionalExtensions = {VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME};
+};
+
+vk::Instance createInstance(const InstanceConfig& config = {});
+// returns a null handle when the instance doesn't have debug utils enabled
+vk::DebugUtilsMessengerEXT createDebugMessenger(vk::Instance instance);
+void destroyDebugMessenger(vk::Instance instance, vk::DebugUtilsMessengerEXT messenger);
+
 void printGpuInfo(size_t& i, vk::PhysicalDevice gpu);
 
+// how an image or buffer was last used on the gpu, kept up to date by BarrierBatch (barriers.hpp). the layout only means something for images
+struct ResourceState {
+    vk::ImageLayout         layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags2 writeStages; // the last write
+    vk::AccessFlags2        writeAccess;
+    vk::PipelineStageFlags2 readStages;  // reads since the last write, all ordered after it already
+    vk::AccessFlags2        readAccess;
+
+    // state after commands recorded outside a BarrierBatch wrote the resource, e.g. a render pass with its final layout
+    static ResourceState written(vk::PipelineStageFlags2 stage, vk::AccessFlags2 access, vk::ImageLayout layout = vk::ImageLayout::eUndefined) {
+        return {layout, stage, access, {}, {}};
+    };
+};
+
 struct Image {
     vk::Image image;
     VmaAllocation allocation;
     VmaAllocationInfo allocationInfo;
+    vk::Extent3D extent;
+    vk::Format format;
+    ResourceState state;
 };
 
 struct Buffer {
     vk::Buffer buffer;
     VmaAllocation allocation;
     VmaAllocationInfo allocationInfo;
+    vk::DeviceSize size;
+    ResourceState state;
+};
+
+// the queue families a context submits to. compute and transfer fall back to the graphics family when the device has no
+// dedicated one, see GraphicsContext::getQueueFamily
+enum class QueueType {
+    eGraphics,
+    eCompute,
+    eTransfer,
+};
+
+constexpr size_t QUEUE_TYPE_COUNT = 3;
+
+// a submission: done once its queue's timeline semaphore reaches `value`. tickets are plain values that any number of later
+// submissions (on any queue of the same context) can wait for on the gpu, see SubmitWait. a default constructed ticket counts as complete
+struct CommandTicket {
+    vk::Semaphore semaphore;
+    uint64_t      value = 0;
+    QueueType     queue = QueueType::eGraphics;
+};
+
+// gpu side dependency of a submission: its `stage` doesn't start before `ticket` completed
+struct SubmitWait {
+    CommandTicket          ticket;
+    vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands;
+};
+
+constexpr uint32_t COMMAND_RING_SIZE = 8;
+
+// a primary command buffer recorded once (without eOneTimeSubmit) and resubmitted as is, see GraphicsContext::recordWorkload.
+// whatever changes between submissions has to come from memory the commands read, e.g. a uniform buffer
+struct RecordedWorkload {
+    vk::CommandBuffer cmd;
+    QueueType         queue = QueueType::eGraphics;
+    CommandTicket     lastSubmit;
+};
+
+// secondary command buffers from GraphicsContext::recordSecondaries, in index order. they have to stay alive until the submission
+// executing them is done, so hand them back through GraphicsContext::releaseSecondaries with that submission's ticket
+struct SecondaryBatch {
+    std::vector<vk::CommandBuffer>  commands;
+    std::vector<ThreadCommandPool*> pools; // the pool each command buffer came from
+};
+
+constexpr uint32_t MIN_TIMESTAMP_QUERIES = 256; // the pool starts with this many, see GraphicsContext::reserveTimestamps
+
+struct GpuTiming {
+    std::string label;
+    double      milliseconds;
+};
+
+// writes the closing timestamp of a GraphicsContext::timestampScope when it goes out of scope. a default constructed scope
+// (timestamps unsupported or out of queries, which collectTimestamps reports) does nothing
+class GpuTimestampScope {
+  public:
+    GpuTimestampScope() = default;
+    GpuTimestampScope(vk::CommandBuffer cmd, vk::QueryPool pool, uint32_t query) : m_Cmd(cmd), m_Pool(pool), m_Query(query) {};
+    GpuTimestampScope(GpuTimestampScope&& other) noexcept;
+    ~GpuTimestampScope();
+
+    GpuTimestampScope(const GpuTimestampScope&)            = delete;
+    GpuTimestampScope& operator=(const GpuTimestampScope&) = delete;
+    GpuTimestampScope& operator=(GpuTimestampScope&&)      = delete;
+
+  private:
+    vk::CommandBuffer m_Cmd;
+    vk::QueryPool     m_Pool;
+    uint32_t          m_Query = 0;
+};
+
+// what an allocation is for, so the driver knows what to page out first under memory pressure (VK_EXT_memory_priority).
+// vma only applies a priority to allocations with their own VkDeviceMemory, so render targets and staging buffers are
+// always dedicated. persistent and transient allocations end up dedicated when they're large, and otherwise share blocks
+// at vma's default priority
+enum class AllocationPriority {
+    eRenderTarget, // attachments being rendered to, 1.0
+    ePersistent,   // device data that lives across jobs, 0.75
+    eTransient,    // short lived, 0.5 (vma's default)
+    eStaging,      // host side copies of finished frames, 0.0
+};
+
+// room left in the vma heap budgets (VK_EXT_memory_budget when enabled, vma's estimate otherwise): `device` for the roomiest
+// device local heap, `host` for the roomiest heap readback buffers can land in
+struct MemoryHeadroom {
+    vk::DeviceSize device = 0;
+    vk::DeviceSize host   = 0;
+};
+
+// host buffer that stays mapped for its whole lifetime. `data` is allocationInfo.pMappedData, reads after a gpu write need
+// GraphicsContext::invalidate and cpu writes before a gpu read need flush (both are no-ops on coherent memory)
+struct MappedBuffer : Buffer {
+    void* data;
+    bool coherent;
+};
+
+// an output file mmap'ed and imported as a buffer (VK_EXT_external_memory_host), the buffer covers the pixel data after the header
+// so a readback lands straight in the page cache. `allocation` is null, the memory is `memory`. see GraphicsContext::createMappedFile
+struct MappedFile : Buffer {
+    vk::DeviceMemory memory;
+    uint8_t*         map        = nullptr; // the whole file, header included
+    size_t           mapSize    = 0;
+    size_t           dataOffset = 0;
+    size_t           dataSize   = 0;
+    int              fd         = -1;
 };
 
 template<typename T>
@@ -62,28 +226,127 @@ constexpr vk::ImageSubresourceLayers STANDARD_IMAGE_SUBRESOURCE_LAYERS = vk::Ima
 
 class GraphicsContext {
   public:
-    GraphicsContext(vk::Instance instance, vk::PhysicalDevice gpu);
+    GraphicsContext(vk::Instance instance, vk::PhysicalDevice gpu, const DeviceConfig& config = {});
     ~GraphicsContext();
 
-    [[nodiscard]] Image createImage(const vk::ImageCreateInfo &ici, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage) const;
-    [[nodiscard]] Buffer createBuffer(const vk::BufferCreateInfo &bci, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage) const;
+    [[nodiscard]] Image createImage(const vk::ImageCreateInfo &ici, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage, AllocationPriority priority = AllocationPriority::eTransient) const;
+    [[nodiscard]] Buffer createBuffer(const vk::BufferCreateInfo &bci, VmaAllocationCreateFlags aci_flags, vk::MemoryPropertyFlags requiredFlags, VmaMemoryUsage usage, vk::MemoryPropertyFlags preferredFlags = {}, AllocationPriority priority = AllocationPriority::eTransient) const;
+
+    // device local memory for `requirements` with nothing bound to it yet, for resources that alias each other (see RenderGraph)
+    [[nodiscard]] VmaAllocation allocateDeviceMemory(const vk::MemoryRequirements& requirements, AllocationPriority priority = AllocationPriority::eTransient) const;
 
-    [[nodiscard]] Image createImageHost(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, bool allowMapping = false) const;
-    [[nodiscard]] Image createImageDevice(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling) const;
+    [[nodiscard]] Image createImageHost(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, bool allowMapping = false, AllocationPriority priority = AllocationPriority::eTransient) const;
+    [[nodiscard]] Image createImageDevice(uint32_t width, uint32_t height, vk::Format format, vk::ImageLayout initialLayout, vk::ImageUsageFlags usage, vk::ImageTiling tiling, AllocationPriority priority = AllocationPriority::eRenderTarget) const;
 
     // host buffers are mappable to read/write
-    [[nodiscard]] Buffer createBufferHost(size_t size, vk::BufferUsageFlags usage) const;
-    [[nodiscard]] Buffer createBufferDevice(size_t size, vk::BufferUsageFlags usage) const;
+    [[nodiscard]] Buffer createBufferHost(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority = AllocationPriority::eTransient) const;
+    [[nodiscard]] Buffer createBufferDevice(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority = AllocationPriority::ePersistent) const;
+    [[nodiscard]] MappedBuffer createMappedBuffer(size_t size, vk::BufferUsageFlags usage, AllocationPriority priority = AllocationPriority::eTransient) const;
+    // mapped buffer for gpu -> cpu transfers. prefers HOST_CACHED memory: host-visible memory without it is usually write-combined,
+    // which cpu reads crawl through. cached memory is often not coherent, so invalidate before reading
+    [[nodiscard]] MappedBuffer createReadbackBuffer(size_t size, vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eTransferDst, AllocationPriority priority = AllocationPriority::eStaging) const;
+
+    void invalidate(const MappedBuffer& buffer, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+    void flush(const MappedBuffer& buffer, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+
+    // begins `cmd` as one time submit, runs f(cmd) and ends it. the callback is called directly, nothing is type erased or allocated.
+    // pools here are created with eResetCommandBuffer, so begin() implicitly resets the buffer
+    template<typename F>
+    void record(vk::CommandBuffer cmd, F&& f) const {
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        std::forward<F>(f)(cmd);
+        cmd.end();
+    };
+
+    // records into a command buffer from the queue's ring and submits it without waiting for completion, the submission signals the
+    // queue's timeline semaphore. `after` are waited for on the gpu, the cpu never blocks on them.
+    // if every slot is in flight this blocks on the oldest one. not thread safe (neither is the queue).
+    template<typename F>
+    [[nodiscard]] CommandTicket recordAndSubmit(QueueType queue, F&& f, std::span<const SubmitWait> after = {}) {
+        return submitSlot(queue, acquireSlot(queue), std::forward<F>(f), after);
+    };
+
+    template<typename F>
+    [[nodiscard]] CommandTicket recordAndSubmit(F&& f) {
+        return recordAndSubmit(QueueType::eGraphics, std::forward<F>(f));
+    };
 
+    // std::function versions of recordAndSubmit (+ a wait for runCommands), for callers that already hold one
     void runCommands(const std::function<void(const vk::CommandBuffer& cmd)>& f);
+    [[nodiscard]] CommandTicket runCommandsAsync(const std::function<void(const vk::CommandBuffer& cmd)>& f);
+    [[nodiscard]] CommandTicket runCommandsAsync(QueueType queue, const std::function<void(const vk::CommandBuffer& cmd)>& f, std::span<const SubmitWait> after = {});
+
+    // records `f` on the graphics queue and a copy of `image` into `buffer` on the transfer queue, the copy waiting for the render's
+    // ticket, with the image's ownership handed over between the families. the graphics queue is free for the next job's
+    // rendering while the copy runs. with no dedicated transfer family both go into one graphics submission.
+    // the returned ticket is the copy's, the copy is made visible to the host. `readbackLabel` opens a timestamp scope around the copy
+    // f has to leave image.state describing what it did to the image (see ResourceState::written)
+    [[nodiscard]] CommandTicket runWithReadback(const std::function<void(const vk::CommandBuffer& cmd)>& f, Image& image, Buffer& buffer, const vk::BufferImageCopy& region, std::string readbackLabel = {});
+    // the two halves of runWithReadback, for renders submitted some other way (e.g. a RecordedWorkload): the render's commands end with
+    // recordReadbackRelease (a no-op without a transfer family), submitReadback copies once `rendered` completed
+    void recordReadbackRelease(const vk::CommandBuffer& cmd, Image& image) const;
+    [[nodiscard]] CommandTicket submitReadback(const CommandTicket& rendered, Image& image, Buffer& buffer, const vk::BufferImageCopy& region, std::string readbackLabel = {});
+
+    // records `f` once into a command buffer from the queue's pool. free it with destroy() once its last submission completed
+    template<typename F>
+    [[nodiscard]] RecordedWorkload recordWorkload(QueueType queue, F&& f) {
+        RecordedWorkload workload{allocateCommandBuffer(queue), queue};
+        try {
+            workload.cmd.begin(vk::CommandBufferBeginInfo{});
+            std::forward<F>(f)(workload.cmd);
+            workload.cmd.end();
+        } catch (...) {
+            destroy(workload);
+            throw;
+        }
+        return workload;
+    };
+    // submits the recorded commands again, nothing is re-recorded. the buffer can't be pending twice, so this waits for the
+    // workload's previous submission first
+    [[nodiscard]] CommandTicket submitWorkload(RecordedWorkload& workload, std::span<const SubmitWait> after = {});
+    void waitForCommands(const CommandTicket& ticket) const;
+    // false when `timeout` ran out first
+    [[nodiscard]] bool waitForCommands(const CommandTicket& ticket, std::chrono::nanoseconds timeout) const;
+    [[nodiscard]] bool commandsComplete(const CommandTicket& ticket) const;
+
+    // gpu timings: open a scope inside a runCommands callback, e.g. `auto t = gc->timestampScope(cmd, "render");`, and the
+    // commands recorded until it is destroyed get timed. collectTimestamps (after the submission completed) converts them with
+    // timestampPeriod, resetTimestamps starts over for the next job
+    // `queue` is the queue `cmd` gets submitted to, the scope is empty on families without timestamp support
+    [[nodiscard]] GpuTimestampScope timestampScope(const vk::CommandBuffer& cmd, std::string label, QueueType queue = QueueType::eGraphics);
+    void resetTimestamps();
+    // grows the pool so a job fits `scopes` scopes, scopes past that are dropped. recreates the pool, so nothing that writes
+    // timestamps may be in flight
+    void reserveTimestamps(uint32_t scopes);
+    [[nodiscard]] inline bool timestampsFit(uint32_t scopes) const noexcept { return !m_TimestampPool || scopes * 2 <= m_TimestampCapacity; };
+    [[nodiscard]] std::vector<GpuTiming> collectTimestamps() const;
+
+    // copies an optimal-tiled image straight into a host-visible buffer (no linear image in between).
+    // the barriers come from the tracked states: the image goes to eTransferSrcOptimal after its last write, the copy is made visible to the host.
+    void recordReadback(const vk::CommandBuffer& cmd, Image& image, Buffer& buffer) const;
+    // same, but only copies `region` (e.g. a tile into its place in a wider buffer through bufferOffset/bufferRowLength)
+    void recordReadback(const vk::CommandBuffer& cmd, Image& image, Buffer& buffer, const vk::BufferImageCopy& region) const;
+    void readbackImage(Image& image, Buffer& buffer);
 
     [[nodiscard]] vk::CommandBuffer allocateCommandBuffer() const;
+    // primary buffer from the queue's ring pool, only use it from the submitting thread
+    [[nodiscard]] vk::CommandBuffer allocateCommandBuffer(QueueType queue) const;
 
-    [[nodiscard]] vk::Fence createFence() const;
+    // graphics family pool owned by the calling thread, created on first use and destroyed with the context. command pools
+    // can't be used from two threads at once, so every recording thread gets its own
+    [[nodiscard]] vk::CommandPool threadCommandPool();
 
-    void waitForFence(vk::Fence fence) const;
+    // records `count` secondary command buffers continuing subpass 0 of `renderPass`/`framebuffer`, spread over the threads of
+    // `pool` (ThreadPool::shared() when null), each recording from its own threadCommandPool. f(cmd, i) records the i-th buffer;
+    // execute them in a render pass begun with eSecondaryCommandBuffers. waits for the recording, so don't call it from a thread of `pool`
+    [[nodiscard]] SecondaryBatch recordSecondaries(uint32_t count, vk::RenderPass renderPass, vk::Framebuffer framebuffer,
+                                                   const std::function<void(const vk::CommandBuffer& cmd, uint32_t index)>& f, ThreadPool* pool = nullptr);
+    // the batch's buffers are reused once `lastUse` completed. like runCommandsAsync, call it from the thread that submits
+    void releaseSecondaries(SecondaryBatch& batch, const CommandTicket& lastUse = {});
 
-    void submitCommands(vk::CommandBuffer cmd, vk::Fence fence) const;
+    // submits a command buffer recorded by the caller (e.g. from threadCommandPool), same timeline and waits as runCommandsAsync.
+    // the buffer must stay alive until the ticket completed
+    [[nodiscard]] CommandTicket submitCommands(vk::CommandBuffer cmd, QueueType queue = QueueType::eGraphics, std::span<const SubmitWait> after = {});
 
     template<inst_destruct T>
     void destroy(const T& v) const {
@@ -97,6 +360,7 @@ class GraphicsContext {
 
     void destroy(const Image&) const;
     void destroy(const Buffer&) const;
+    void destroy(const RecordedWorkload&) const;
 
     void freeAllocation(VmaAllocation alloc) const;
 
@@ -111,12 +375,33 @@ class GraphicsContext {
     void unmapMemory(const VmaAllocation& allocation) const;
 
 
-    // assumes image/buffer is host side and mappable
+    // assumes image/buffer is host side and mappable. nothing is copied, the encoder reads the mapped memory directly
     void saveImage(const std::string& path, const Image& image, int width, int height, int channels, int bpp) const;
     void saveBufferImage(const std::string& path, const Buffer& bufferImage, int width, int height, int channels, int bpp) const;
-
-    static void saveImage(const std::string& path, const void* data, int width, int height, int channels, int bpp);
-
+    void saveBufferImage(const std::string& path, const MappedBuffer& bufferImage, int width, int height, int channels, int bpp, std::optional<OutputFormat> format = {}) const;
+
+    // encodes straight from `data` (typically a mapping), rows are `stride` bytes apart, 0 = width * bpp.
+    // without a format it's picked from the path's extension
+    static void saveImage(const std::string& path, const void* data, int width, int height, int channels, int bpp, size_t stride = 0, std::optional<OutputFormat> format = {});
+
+    // persistently mapped host buffers used as readback targets, recycled through resources()
+    [[nodiscard]] MappedBuffer acquireStagingBuffer(size_t size);
+    void releaseStagingBuffer(const MappedBuffer& buffer);
+
+    // encodes and writes the buffer on the writer pool so the calling thread can go on with the next job.
+    // the gpu must be done writing to the buffer. ownership passes to the writer, which releases it back to the staging pool once the file is written.
+    [[nodiscard]] std::future<void> saveBufferImageAsync(const std::string& path, const MappedBuffer& bufferImage, int width, int height, int channels, int bpp, std::optional<OutputFormat> format = {});
+
+    // output files the gpu writes into directly. only for formats with a raw layout (the header is padded so the pixels start at
+    // minImportedHostPointerAlignment), and only on posix with VK_EXT_external_memory_host and coherent importable memory.
+    // returns nullopt whenever that doesn't work out, the caller falls back to a staging buffer
+    [[nodiscard]] bool supportsMappedFiles() const noexcept;
+    [[nodiscard]] std::optional<MappedFile> createMappedFile(const std::string& path, OutputFormat format, uint32_t width, uint32_t height, uint32_t channels) const;
+    // the gpu must be done with the buffer. unmaps and trims the file to its real size
+    void closeMappedFile(MappedFile& file) const;
+
+    // spir-v is cached under cacheDirectory()/spirv keyed by source, entry point, optimization level and compiler version,
+    // a warm cache never touches the glsl front end
     [[nodiscard]] std::vector<uint32_t> compileShader(const std::string& path) const;
     [[nodiscard]] std::vector<uint32_t> compileShader(const std::string& path, const std::string& entry_point) const;
 
@@ -124,6 +409,21 @@ class GraphicsContext {
     [[nodiscard]] vk::ShaderModule buildShaderModule(const std::string& path, const std::string& entry_point) const;
 
     [[nodiscard]] inline vk::Device getDevice() const noexcept { return m_Device; };
+    [[nodiscard]] inline const vk::PhysicalDeviceProperties& getProperties() const noexcept { return m_GpuProperties.properties; };
+    [[nodiscard]] inline const DeviceConfig& getConfig() const noexcept { return m_Config; };
+    [[nodiscard]] inline uint32_t getQueueFamily(QueueType queue) const noexcept { return m_QueueFamilies[(size_t)queue]; };
+    [[nodiscard]] inline vk::Queue getQueue(QueueType queue) const noexcept { return m_Queues[(size_t)queue]; };
+    // true when readback copies go to their own family instead of the graphics queue
+    [[nodiscard]] inline bool hasTransferQueue() const noexcept { return getQueueFamily(QueueType::eTransfer) != getQueueFamily(QueueType::eGraphics); };
+    [[nodiscard]] bool hasExtension(const char* name) const;
+
+    // loaded from cacheDirectory()/pipeline at startup and merged back at shutdown. the file is keyed by vendor, device and pipelineCacheUUID so
+    // every device of the same model (and driver) shares one
+    [[nodiscard]] inline vk::PipelineCache getPipelineCache() const noexcept { return m_PipelineCache; };
+
+    [[nodiscard]] inline ResourceCache& resources() noexcept { return *m_Resources; };
+    [[nodiscard]] MemoryHeadroom memoryHeadroom() const;
+    [[nodiscard]] inline VmaAllocator getAllocator() const noexcept { return m_Allocator; };
 
     [[nodiscard]] vk::ImageView createImageView(const Image &image, vk::Format format) const;
     [[nodiscard]] vk::Framebuffer createFramebuffer(vk::RenderPass rp, vk::ImageView iv, vk::Extent2D extent) const;
@@ -131,14 +431,80 @@ class GraphicsContext {
   private:
     vk::Instance m_Instance;
     vk::PhysicalDevice m_Gpu;
+    DeviceConfig m_Config;
+    std::vector<std::string> m_EnabledExtensions;
     vk::Device m_Device;
-    vk::Queue m_Queue;
+    std::array<uint32_t, QUEUE_TYPE_COUNT> m_QueueFamilies{};
+    std::array<vk::Queue, QUEUE_TYPE_COUNT> m_Queues;
     vk::CommandPool m_Pool;
     VmaAllocator m_Allocator;
+    vk::PipelineCache m_PipelineCache;
+
+    struct CommandSlot {
+        vk::CommandBuffer cmd;
+        uint64_t          value = 0; // timeline value of the slot's last submission, the buffer is free again once it's reached
+    };
+
+    struct CommandRing {
+        vk::CommandPool                            pool;
+        std::array<CommandSlot, COMMAND_RING_SIZE> slots;
+        uint32_t                                   head = 0;
+    };
+
+    std::array<CommandRing, QUEUE_TYPE_COUNT> m_Rings;
+    // one timeline per queue type, every submission to it signals the next value
+    std::array<vk::Semaphore, QUEUE_TYPE_COUNT> m_Timelines;
+    std::array<uint64_t, QUEUE_TYPE_COUNT>      m_TimelineValues{};
+
+    struct RetiredBatch {
+        SecondaryBatch batch;
+        CommandTicket  lastUse;
+    };
+
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadCommandPool>> m_ThreadPools;
+    std::mutex                                                              m_ThreadPoolsMutex;
+    std::vector<RetiredBatch>                                               m_RetiredBatches; // waiting on their submission
+
+    std::unique_ptr<ThreadPool>    m_Writers;
+    std::unique_ptr<ResourceCache> m_Resources;
+
+    vk::QueryPool            m_TimestampPool;
+    bool                     m_TimestampsSupported = false;
+    uint32_t                 m_TimestampValidBits  = 0; // the smallest over the families that write timestamps
+    std::array<bool, QUEUE_TYPE_COUNT> m_QueueTimestamps{};
+    uint32_t                 m_TimestampCapacity   = 0; // queries in the pool
+    uint32_t                 m_NextQuery           = 0;
+    uint32_t                 m_DroppedScopes       = 0; // since the last reset, the pool was full
+    std::vector<std::string> m_TimestampLabels;
+
+    vk::DeviceSize m_HostImportAlignment = 0; // 0 = no VK_EXT_external_memory_host
+    bool           m_MemoryPriority      = false; // VK_EXT_memory_priority enabled with its feature, vma passes the priorities on
 
     vk::PhysicalDeviceProperties2 m_GpuProperties;
     vk::PhysicalDevicePCIBusInfoPropertiesEXT m_GpuPciInfo;
 
     void createDevice();
     void createAllocator();
+    void createCommandRings();
+    // takes the ring's next slot, waiting for its previous submission if needed
+    [[nodiscard]] uint32_t acquireSlot(QueueType queue);
+    template<typename F>
+    CommandTicket submitSlot(QueueType queue, uint32_t index, F&& f, std::span<const SubmitWait> after = {}) {
+        auto& slot = m_Rings[(size_t)queue].slots[index];
+        record(slot.cmd, std::forward<F>(f));
+
+        CommandTicket ticket = submitTimeline(queue, slot.cmd, after);
+        slot.value           = ticket.value;
+        return ticket;
+    };
+    CommandTicket submitTimeline(QueueType queue, vk::CommandBuffer cmd, std::span<const SubmitWait> after);
+    [[nodiscard]] ThreadCommandPool& threadPoolState();
+    // hands the buffers of completed retired batches back to their pools
+    void recycleSecondaries();
+    void createPipelineCache();
+    void createTimestampPool();
+    void savePipelineCache() const;
+
+    [[nodiscard]] std::string pipelineCacheName() const;
+    [[nodiscard]] bool isCompatiblePipelineCache(const std::vector<uint8_t>& data) const;
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+#pragma shader_stage(fragment)
+
+// per job values, written by the renderer before each submission of a recorded workload
+layout(set = 0, binding = 0) uniform JobParameters {
+    vec4 clearColor;
+} params;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = params.clearColor;
+}
@@ -3,6 +3,12 @@
 
 layout(location = 0) out vec3 fragColor;
 
+// maps canvas clip space onto the tile being rendered, identity when the job isn't tiled
+layout(push_constant) uniform Tile {
+    vec2 scale;
+    vec2 offset;
+} tile;
+
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
     vec2(0.5, 0.5),
@@ -16,6 +22,6 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = vec4(positions[gl_VertexIndex] * tile.scale + tile.offset, 0.0, 1.0);
     fragColor = colors[gl_VertexIndex];
 }
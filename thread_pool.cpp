@@ -0,0 +1,42 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) threadCount = 1;
+
+    m_Threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        m_Threads.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_Cv.notify_all();
+
+    for (auto& t : m_Threads) {
+        t.join();
+    }
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Cv.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+            if (m_Tasks.empty()) return; // only reached when stopping, queued work is drained first
+
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+        }
+        task();
+    }
+}
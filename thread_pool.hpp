@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// minimal fixed size thread pool, tasks run in fifo order
+class ThreadPool {
+  public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R   = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto fut  = task->get_future();
+
+        {
+            std::lock_guard lock(m_Mutex);
+            m_Tasks.emplace_back([task]() { (*task)(); });
+        }
+        m_Cv.notify_one();
+
+        return fut;
+    };
+
+    [[nodiscard]] inline size_t size() const noexcept { return m_Threads.size(); };
+
+    // process wide pool used for cpu heavy work such as image encoding
+    static ThreadPool& shared();
+
+  private:
+    std::vector<std::thread>          m_Threads;
+    std::deque<std::function<void()>> m_Tasks;
+    std::mutex                        m_Mutex;
+    std::condition_variable           m_Cv;
+    bool                              m_Stopping = false;
+
+    void workerLoop();
+};